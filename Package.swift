@@ -21,5 +21,9 @@ let package = Package(
             name: "SMCKit",
             dependencies: ["SMC"]
         ),
+        .executableTarget(
+            name: "SMCBenchmarks",
+            dependencies: ["SMC", "SMCKit"]
+        ),
     ]
 )
@@ -26,6 +26,7 @@
 #define SMC_H
 
 #include <IOKit/IOKitLib.h>
+#include <stdbool.h>
 
 #define SMC_KERNEL_INDEX 2
 
@@ -95,17 +96,367 @@ typedef struct {
   smc_return_t smc_res;
 } SMCResult_t;
 
+// A key with its info resolved ahead of time, see SMCResolveKey.
+typedef struct {
+  UInt32 key;
+  UInt32 dataSize;
+  UInt32 dataType;
+} SMCKeyHandle_t;
+
 kern_return_t SMCOpen(io_connect_t *conn);
 kern_return_t SMCClose(io_connect_t conn);
 
+// Issues a single command to the SMC with no caching. Everything else in this
+// library is built on it.
+kern_return_t SMCCall(int selector, const SMCKeyData_t *inputStructure,
+                      SMCKeyData_t *outputStructure, io_connect_t conn);
+
 SMCResult_t SMCReadKey(const UInt32Char_t *key, SMCVal_t *val,
                        io_connect_t conn);
+// Reads n keys in one pass. vals and results must hold n entries each and
+// receive the value and status of the matching key.
+kern_return_t SMCReadKeys(const UInt32Char_t *keys, SMCVal_t *vals,
+                          SMCResult_t *results, size_t n, io_connect_t conn);
 SMCResult_t SMCWriteKey(const SMCVal_t *val, io_connect_t conn);
+// Writes n values in one pass, checking each against its key's info as
+// SMCWriteKey does. results must hold n entries and receives the status of the
+// matching write.
+kern_return_t SMCWriteKeys(const SMCVal_t *vals, SMCResult_t *results,
+                           size_t n, io_connect_t conn);
+// The key count and the index-to-key mapping are cached with the key info
+// after the first lookup, so repeated enumerations don't go back to the SMC.
+// SMCCleanupCache drops them along with the key info.
+SMCResult_t SMCGetKeyCount(UInt32 *count, io_connect_t conn);
 SMCResult_t SMCGetKeyFromIndex(UInt32 index, UInt32Char_t *key,
                                io_connect_t conn);
 SMCResult_t SMCGetKeyInfo(UInt32 key, SMCKeyData_keyInfo_t *keyInfo,
                           io_connect_t conn);
 
+// Sets found to whether the key exists. Missing keys are cached, so repeated
+// probes for them return without asking the SMC. Only failures other than a
+// missing key are reported in the result.
+SMCResult_t SMCIsKeyFound(UInt32 key, bool *found, io_connect_t conn);
+
+// Resolves a key's info once so it can be read or written without a cache
+// lookup each time. Handles stay valid for the life of the SMC firmware and
+// can be used with any connection.
+SMCResult_t SMCResolveKey(const UInt32Char_t *key, SMCKeyHandle_t *handle,
+                          io_connect_t conn);
+SMCResult_t SMCReadKeyResolved(const SMCKeyHandle_t *handle, SMCVal_t *val,
+                               io_connect_t conn);
+// Writes val->bytes to the resolved key; the rest of val is ignored.
+SMCResult_t SMCWriteKeyResolved(const SMCKeyHandle_t *handle,
+                                const SMCVal_t *val, io_connect_t conn);
+
+// Asks the SMC every time; SMCContextReadVersion caches the version.
+SMCResult_t SMCReadVersion(SMCKeyData_vers_t *vers, io_connect_t conn);
+// Reads the CPU, GPU and memory power limits in a single SMC call.
+SMCResult_t SMCReadPowerLimits(SMCKeyData_pLimitData_t *limits,
+                               io_connect_t conn);
+
+// Fills the key info cache with every key in a single pass, using extra
+// connections to the SMC where they can be opened.
+SMCResult_t SMCPrefetchKeyInfo(io_connect_t conn);
+
+// Like SMCPrefetchKeyInfo, then freezes the complete key set into a read-only
+// table that answers later lookups with a single cache-line probe and no
+// writes to shared memory. Keys outside the frozen set, such as ones probed
+// but not present, still go through the regular cache. SMCCleanupCache drops
+// the frozen table along with everything else.
+SMCResult_t SMCFreezeKeyInfo(io_connect_t conn);
+
+// Fills the key info cache from the file at path if it was written for the
+// same SMC firmware. Otherwise the cache is rebuilt from the SMC and the file
+// is replaced atomically; failing to write it doesn't fail the call. SMCs that
+// don't report a firmware version are matched on their key count alone.
+SMCResult_t SMCLoadKeyInfoCache(const char *path, io_connect_t conn);
+
+// Empties the shared cache: the key info, the key count and index-to-key
+// mapping, and the firmware version, which are all read from the SMC again
+// when next needed.
 void SMCCleanupCache(void);
 
+// Snapshots: a full dump of every key's type, size and value in a compact
+// file that is mapped and queried in place. The file is a header followed by
+// fixed-width records sorted by key, all little-endian. Snapshots written by
+// different versions of the library are told apart by the header's format.
+typedef struct {
+  UInt32 key;
+  UInt32 dataType;
+  UInt32 dataSize;
+  // The SMC status of the read: bytes is zeroed unless kSMCReturnSuccess.
+  UInt8 status;
+  UInt8 dataAttributes;
+  UInt16 reserved;
+  SMCBytes_t bytes;
+} SMCSnapshotRecord_t;
+
+typedef struct SMCSnapshot SMCSnapshot_t;
+
+// Reads every key the SMC reports and writes them to path atomically.
+SMCResult_t SMCWriteSnapshot(const char *path, io_connect_t conn);
+
+// Maps a snapshot read-only. Fails with kIOReturnBadMedia if the file is not
+// a snapshot in a format this library understands.
+kern_return_t SMCSnapshotOpen(const char *path, SMCSnapshot_t **snapshot);
+void SMCSnapshotClose(SMCSnapshot_t *snapshot);
+
+// The SMC firmware version, zeroed if the SMC didn't report one, and the
+// wall-clock time (seconds since 1970) when the snapshot was taken.
+SMCKeyData_vers_t SMCSnapshotVersion(const SMCSnapshot_t *snapshot);
+UInt64 SMCSnapshotTimestamp(const SMCSnapshot_t *snapshot);
+
+// The records, sorted by key. They point into the mapping and stay valid until
+// the snapshot is closed.
+UInt32 SMCSnapshotCount(const SMCSnapshot_t *snapshot);
+const SMCSnapshotRecord_t *SMCSnapshotRecords(const SMCSnapshot_t *snapshot);
+// Binary-searches for a key, returning NULL if the snapshot doesn't have it.
+const SMCSnapshotRecord_t *SMCSnapshotFind(const SMCSnapshot_t *snapshot,
+                                           UInt32 key);
+
+// Calls fn, in key order, for every key whose type, size, status or value
+// differs between a and b. Keys present in only one snapshot are reported with
+// NULL for the other record.
+typedef void (*SMCSnapshotDiffFn)(const SMCSnapshotRecord_t *a,
+                                  const SMCSnapshotRecord_t *b, void *context);
+void SMCSnapshotDiff(const SMCSnapshot_t *a, const SMCSnapshot_t *b,
+                     SMCSnapshotDiffFn fn, void *context);
+
+// Key catalogs: the type and size of every key, read once and then queried
+// without going back to the SMC. Entries are kept sorted both by key and by
+// type, so prefix and type queries return a contiguous range of one of the two
+// arrays, found by binary search.
+typedef struct {
+  UInt32 key;
+  UInt32 dataType;
+  UInt32 dataSize;
+  UInt8 dataAttributes;
+} SMCCatalogEntry_t;
+
+typedef struct SMCCatalog SMCCatalog_t;
+
+// Reads the info of every key the SMC reports, filling the key info cache as
+// a side effect.
+SMCResult_t SMCCatalogCreate(io_connect_t conn, SMCCatalog_t **catalog);
+void SMCCatalogDestroy(SMCCatalog_t *catalog);
+
+// The entries sorted by key, and the same entries sorted by type and then by
+// key. Both stay valid until the catalog is destroyed.
+UInt32 SMCCatalogCount(const SMCCatalog_t *catalog);
+const SMCCatalogEntry_t *SMCCatalogEntries(const SMCCatalog_t *catalog);
+const SMCCatalogEntry_t *SMCCatalogEntriesByType(const SMCCatalog_t *catalog);
+
+// Returns NULL if the catalog doesn't have the key.
+const SMCCatalogEntry_t *SMCCatalogFind(const SMCCatalog_t *catalog,
+                                        UInt32 key);
+// Counts the keys starting with prefix, a string of up to four characters,
+// and sets first to the index of the first of them in SMCCatalogEntries.
+UInt32 SMCCatalogPrefixRange(const SMCCatalog_t *catalog, const char *prefix,
+                             UInt32 *first);
+// Counts the keys of dataType and sets first to the index of the first of
+// them in SMCCatalogEntriesByType.
+UInt32 SMCCatalogTypeRange(const SMCCatalog_t *catalog, UInt32 dataType,
+                           UInt32 *first);
+
+// Brokers: one process publishes the latest value of each key into a named
+// shared-memory table, and any number of other processes read it without
+// locks and without an SMC connection. Each key's slot is guarded by a
+// sequence counter, so a reader that overlaps a write simply retries.
+typedef struct SMCBroker SMCBroker_t;
+
+// Publishes an empty table under name, a POSIX shared memory name such as
+// "/smckit.telemetry", replacing any table already there. capacity bounds
+// the number of keys, at most 65536, or 0 for a default of 256. The table is
+// only accessible to processes running as the same user.
+kern_return_t SMCBrokerCreate(const char *name, UInt32 capacity,
+                              SMCBroker_t **broker);
+// Maps the table published under name read-only. Fails with kIOReturnNotFound
+// if nothing is published there.
+kern_return_t SMCBrokerOpen(const char *name, SMCBroker_t **broker);
+// Closing the publisher retires its table and removes its name.
+void SMCBrokerClose(SMCBroker_t *broker);
+
+// Stores the outcome of reading val->key, with its uptime timestamp in
+// nanoseconds. Safe to call from several threads of the publisher. Fails with
+// kIOReturnNoSpace once capacity keys have been published.
+kern_return_t SMCBrokerPublish(SMCBroker_t *broker, const SMCVal_t *val,
+                               SMCResult_t result, UInt64 timestamp);
+// Returns the published result of the key's last read, and its value and
+// timestamp when that read succeeded. Keys never published report
+// kSMCReturnKeyNotFound.
+SMCResult_t SMCBrokerRead(const SMCBroker_t *broker, const UInt32Char_t *key,
+                          SMCVal_t *val, UInt64 *timestamp);
+UInt32 SMCBrokerCount(const SMCBroker_t *broker);
+// Whether the publisher has closed the table. Clients should reopen it by
+// name to pick up a new publisher.
+bool SMCBrokerRetired(const SMCBroker_t *broker);
+
+// Transports: the function table SMC commands go through. Connections and
+// contexts use IOKit unless a context is created with another transport, such
+// as a recorder that captures a workload or a replay of one that needs no
+// AppleSMC at all. call has the contract of IOConnectCallStructMethod on the
+// AppleSMC user client.
+typedef struct {
+  kern_return_t (*open)(void *context, io_connect_t *conn);
+  void (*close)(void *context, io_connect_t conn);
+  kern_return_t (*call)(void *context, io_connect_t conn, int selector,
+                        const SMCKeyData_t *inputStructure,
+                        SMCKeyData_t *outputStructure);
+  void *context;
+} SMCTransport_t;
+
+const SMCTransport_t *SMCIOKitTransport(void);
+
+// Records every call passed to inner, or to IOKit if inner is NULL, with its
+// result and latency. The recorder must outlive the contexts using it.
+typedef struct SMCRecorder SMCRecorder_t;
+
+kern_return_t SMCRecorderCreate(const SMCTransport_t *inner,
+                                SMCRecorder_t **recorder);
+void SMCRecorderDestroy(SMCRecorder_t *recorder);
+const SMCTransport_t *SMCRecorderTransport(SMCRecorder_t *recorder);
+size_t SMCRecorderCount(SMCRecorder_t *recorder);
+// Writes the calls recorded so far to path atomically.
+kern_return_t SMCRecorderSave(SMCRecorder_t *recorder, const char *path);
+
+// Answers calls from a recording. Each call gets the next recorded response
+// to the same command, key and index, cycling once they run out, so replays
+// are deterministic however the workload interleaves. Calls never recorded
+// report kSMCReturnKeyNotFound and count as misses.
+typedef struct SMCReplay SMCReplay_t;
+
+kern_return_t SMCReplayOpen(const char *path, SMCReplay_t **replay);
+void SMCReplayClose(SMCReplay_t *replay);
+const SMCTransport_t *SMCReplayTransport(SMCReplay_t *replay);
+// Each replayed call waits recordedScale times its recorded latency plus
+// extraNanoseconds. Both are 0, for no waiting, until set.
+void SMCReplaySetLatency(SMCReplay_t *replay, double recordedScale,
+                         UInt64 extraNanoseconds);
+UInt64 SMCReplayMisses(const SMCReplay_t *replay);
+
+// Instrumentation. Everything is off by default and costs a single relaxed
+// load per SMC command while off.
+#define SMC_STATS_COMMANDS 16
+// Bucket b counts commands that took [2^b, 2^(b+1)) nanoseconds.
+#define SMC_STATS_LATENCY_BUCKETS 32
+#define SMC_STATS_KERN_ERRORS 16
+
+typedef struct {
+  kern_return_t code;
+  UInt64 count;
+} SMCKernErrorCount_t;
+
+typedef struct {
+  // Indexed by SMC command (SMC_CMD_*).
+  UInt64 calls[SMC_STATS_COMMANDS];
+  UInt64 latency[SMC_STATS_COMMANDS][SMC_STATS_LATENCY_BUCKETS];
+
+  UInt64 cacheHits;
+  UInt64 cacheAbsentHits; // hits on keys cached as missing
+  UInt64 cacheMisses;
+  UInt64 cacheInserts;
+  UInt64 cacheEvictions; // keys dropped from a bounded SMCContext cache
+
+  // Failed commands by status. The first kernErrorCount entries of
+  // kernErrors are used; codes beyond SMC_STATS_KERN_ERRORS distinct values
+  // are not tracked.
+  UInt64 smcErrors[256];
+  SMCKernErrorCount_t kernErrors[SMC_STATS_KERN_ERRORS];
+  UInt32 kernErrorCount;
+} SMCStats_t;
+
+// Turns counting on or off. Counters keep their values while off.
+void SMCSetStatsEnabled(bool enabled);
+bool SMCStatsEnabled(void);
+// Emits an os_signpost interval around every SMC command, for Instruments.
+void SMCSetSignpostsEnabled(bool enabled);
+
+void SMCGetStats(SMCStats_t *stats);
+void SMCResetStats(void);
+
+// A connection with a key info cache of its own, so its memory can be bounded
+// and it can be reset without affecting the rest of the process. The
+// connection-based functions above all share one unbounded cache instead.
+typedef struct SMCContext SMCContext_t;
+
+// Opens a connection and creates an empty cache holding at most cacheCapacity
+// keys, or any number of keys if cacheCapacity is 0. Once full, keys that
+// haven't been used recently are evicted.
+kern_return_t SMCContextCreate(UInt32 cacheCapacity, SMCContext_t **context);
+// Like SMCContextCreate, but the connection is opened through transport and
+// every call through the context goes to transport, which must outlive it.
+kern_return_t SMCContextCreateWithTransport(UInt32 cacheCapacity,
+                                            const SMCTransport_t *transport,
+                                            SMCContext_t **context);
+// Closes the connection. The context must not be in use by another thread.
+void SMCContextDestroy(SMCContext_t *context);
+// The connection the transport opened, MACH_PORT_NULL for a replay. The
+// connection-based functions send calls on it straight to IOKit, bypassing
+// the context's transport and cache.
+io_connect_t SMCContextConnection(const SMCContext_t *context);
+
+// Empties the context's cache, including its key count, index-to-key mapping
+// and firmware version. Safe to call while other threads use it.
+void SMCContextResetCache(SMCContext_t *context);
+size_t SMCContextCacheCount(const SMCContext_t *context);
+
+// As the functions without the Context prefix, with key info, the key count
+// and the index-to-key mapping going through the context's cache and every
+// call through its transport.
+SMCResult_t SMCContextGetKeyInfo(SMCContext_t *context, UInt32 key,
+                                 SMCKeyData_keyInfo_t *keyInfo);
+SMCResult_t SMCContextIsKeyFound(SMCContext_t *context, UInt32 key,
+                                 bool *found);
+SMCResult_t SMCContextResolveKey(SMCContext_t *context, const UInt32Char_t *key,
+                                 SMCKeyHandle_t *handle);
+SMCResult_t SMCContextReadKey(SMCContext_t *context, const UInt32Char_t *key,
+                              SMCVal_t *val);
+SMCResult_t SMCContextReadKeyResolved(SMCContext_t *context,
+                                      const SMCKeyHandle_t *handle,
+                                      SMCVal_t *val);
+kern_return_t SMCContextReadKeys(SMCContext_t *context,
+                                 const UInt32Char_t *keys, SMCVal_t *vals,
+                                 SMCResult_t *results, size_t n);
+SMCResult_t SMCContextWriteKey(SMCContext_t *context, const SMCVal_t *val);
+SMCResult_t SMCContextWriteKeyResolved(SMCContext_t *context,
+                                       const SMCKeyHandle_t *handle,
+                                       const SMCVal_t *val);
+kern_return_t SMCContextWriteKeys(SMCContext_t *context, const SMCVal_t *vals,
+                                  SMCResult_t *results, size_t n);
+SMCResult_t SMCContextGetKeyCount(SMCContext_t *context, UInt32 *count);
+SMCResult_t SMCContextGetKeyFromIndex(SMCContext_t *context, UInt32 index,
+                                      UInt32Char_t *key);
+SMCResult_t SMCContextPrefetchKeyInfo(SMCContext_t *context);
+SMCResult_t SMCContextFreezeKeyInfo(SMCContext_t *context);
+SMCResult_t SMCContextLoadKeyInfoCache(SMCContext_t *context,
+                                       const char *path);
+// Like SMCReadVersion, but only the first successful call, or the first after
+// SMCContextResetCache, goes to the SMC; the firmware can't change while the
+// connection is open. Loading a cache file
+// and writing a snapshot through the context reuse the cached version.
+SMCResult_t SMCContextReadVersion(SMCContext_t *context,
+                                  SMCKeyData_vers_t *vers);
+SMCResult_t SMCContextReadPowerLimits(SMCContext_t *context,
+                                      SMCKeyData_pLimitData_t *limits);
+SMCResult_t SMCContextCreateCatalog(SMCContext_t *context,
+                                    SMCCatalog_t **catalog);
+SMCResult_t SMCContextWriteSnapshot(SMCContext_t *context, const char *path);
+
+// A fixed set of connections shared between threads. Each call takes
+// whichever connection is idle, blocking while all of them are busy.
+typedef struct SMCPool SMCPool_t;
+
+kern_return_t SMCPoolCreate(size_t size, SMCPool_t **pool);
+void SMCPoolDestroy(SMCPool_t *pool);
+size_t SMCPoolSize(const SMCPool_t *pool);
+
+io_connect_t SMCPoolAcquire(SMCPool_t *pool);
+void SMCPoolRelease(SMCPool_t *pool, io_connect_t conn);
+
+SMCResult_t SMCPoolReadKey(SMCPool_t *pool, const UInt32Char_t *key,
+                           SMCVal_t *val);
+SMCResult_t SMCPoolWriteKey(SMCPool_t *pool, const SMCVal_t *val);
+kern_return_t SMCPoolReadKeys(SMCPool_t *pool, const UInt32Char_t *keys,
+                              SMCVal_t *vals, SMCResult_t *results, size_t n);
+
 #endif
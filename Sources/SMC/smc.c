@@ -22,29 +22,12 @@
  SOFTWARE.
 */
 
-#include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
-#include "khashl.h"
 #include "smc.h"
-
-KHASHL_MAP_INIT(KH_LOCAL, mapKeyInfo_t, mapKeyInfo, uint32_t,
-                SMCKeyData_keyInfo_t, kh_hash_uint32, kh_eq_generic)
-
-static mapKeyInfo_t *g_keyInfoCache = NULL;
-static pthread_mutex_t g_keyInfoCacheLock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_once_t g_cacheInitOnce = PTHREAD_ONCE_INIT;
-
-static void init_cache(void) { g_keyInfoCache = mapKeyInfo_init(); }
-
-static void destroy_cache(void) {
-  if (g_keyInfoCache == NULL)
-    return;
-
-  mapKeyInfo_destroy(g_keyInfoCache);
-  g_keyInfoCache = NULL;
-}
+#include "smc_internal.h"
 
 UInt32 FourCharCodeFromString(const UInt32Char_t *str) {
   if (str == NULL)
@@ -83,18 +66,30 @@ kern_return_t SMCOpen(io_connect_t *conn) {
 
 kern_return_t SMCClose(const io_connect_t conn) { return IOServiceClose(conn); }
 
+kern_return_t SMCTransportCall(const SMCTransport_t *transport,
+                               const int selector,
+                               const SMCKeyData_t *inputStructure,
+                               SMCKeyData_t *outputStructure,
+                               const io_connect_t conn) {
+  const int instrumentation = SMCInstrumentation();
+  if (instrumentation != 0) {
+    return SMCInstrumentedCall(instrumentation, transport, selector,
+                               inputStructure, outputStructure, conn);
+  }
+  return SMCTransportDispatch(transport, selector, inputStructure,
+                              outputStructure, conn);
+}
+
 kern_return_t SMCCall(const int selector, const SMCKeyData_t *inputStructure,
                       SMCKeyData_t *outputStructure, const io_connect_t conn) {
-  const size_t structureInputSize = sizeof(SMCKeyData_t);
-  size_t structureOutputSize = sizeof(SMCKeyData_t);
-
-  return IOConnectCallStructMethod(conn, selector, inputStructure,
-                                   structureInputSize, outputStructure,
-                                   &structureOutputSize);
+  return SMCTransportCall(NULL, selector, inputStructure, outputStructure,
+                          conn);
 }
 
-SMCResult_t SMCReadKey(const UInt32Char_t *key, SMCVal_t *val,
-                       const io_connect_t conn) {
+SMCResult_t SMCCachedReadKey(SMCKeyInfoCache_t *cache,
+                             const SMCTransport_t *transport,
+                             const UInt32Char_t *key, SMCVal_t *val,
+                             const io_connect_t conn) {
   SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
 
   if (key == NULL || val == NULL) {
@@ -112,7 +107,8 @@ SMCResult_t SMCReadKey(const UInt32Char_t *key, SMCVal_t *val,
   inputStructure.key = keyCode;
   StringFromFourCharCode(keyCode, &val->key);
 
-  result = SMCGetKeyInfo(keyCode, &outputStructure.keyInfo, conn);
+  result = SMCCachedGetKeyInfo(cache, transport, keyCode,
+                               &outputStructure.keyInfo, conn);
 
   if (result.kern_res != kIOReturnSuccess ||
       result.smc_res != kSMCReturnSuccess) {
@@ -126,7 +122,8 @@ SMCResult_t SMCReadKey(const UInt32Char_t *key, SMCVal_t *val,
   inputStructure.data8 = SMC_CMD_READ_KEY;
 
   result.kern_res =
-      SMCCall(SMC_KERNEL_INDEX, &inputStructure, &outputStructure, conn);
+      SMCTransportCall(transport, SMC_KERNEL_INDEX, &inputStructure,
+                       &outputStructure, conn);
   result.smc_res = outputStructure.result;
   if (result.kern_res != kIOReturnSuccess ||
       result.smc_res != kSMCReturnSuccess) {
@@ -137,7 +134,14 @@ SMCResult_t SMCReadKey(const UInt32Char_t *key, SMCVal_t *val,
   return result;
 }
 
-SMCResult_t SMCWriteKey(const SMCVal_t *val, const io_connect_t conn) {
+SMCResult_t SMCReadKey(const UInt32Char_t *key, SMCVal_t *val,
+                       const io_connect_t conn) {
+  return SMCCachedReadKey(SMCSharedKeyInfoCache(), NULL, key, val, conn);
+}
+
+SMCResult_t SMCCachedWriteKey(SMCKeyInfoCache_t *cache,
+                              const SMCTransport_t *transport,
+                              const SMCVal_t *val, const io_connect_t conn) {
   SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
 
   if (val == NULL) {
@@ -147,7 +151,7 @@ SMCResult_t SMCWriteKey(const SMCVal_t *val, const io_connect_t conn) {
   SMCKeyData_keyInfo_t keyData;
 
   const UInt32 keyCode = FourCharCodeFromString(&val->key);
-  result = SMCGetKeyInfo(keyCode, &keyData, conn);
+  result = SMCCachedGetKeyInfo(cache, transport, keyCode, &keyData, conn);
   if (result.kern_res != kIOReturnSuccess ||
       result.smc_res != kSMCReturnSuccess) {
     return result;
@@ -172,7 +176,8 @@ SMCResult_t SMCWriteKey(const SMCVal_t *val, const io_connect_t conn) {
   memcpy(inputStructure.bytes, val->bytes, sizeof(val->bytes));
 
   result.kern_res =
-      SMCCall(SMC_KERNEL_INDEX, &inputStructure, &outputStructure, conn);
+      SMCTransportCall(transport, SMC_KERNEL_INDEX, &inputStructure,
+                       &outputStructure, conn);
   result.smc_res = outputStructure.result;
 
   if (result.kern_res != kIOReturnSuccess ||
@@ -183,14 +188,83 @@ SMCResult_t SMCWriteKey(const SMCVal_t *val, const io_connect_t conn) {
   return result;
 }
 
-SMCResult_t SMCGetKeyFromIndex(const UInt32 index, UInt32Char_t *key,
-                               const io_connect_t conn) {
+SMCResult_t SMCWriteKey(const SMCVal_t *val, const io_connect_t conn) {
+  return SMCCachedWriteKey(SMCSharedKeyInfoCache(), NULL, val, conn);
+}
+
+kern_return_t SMCCachedWriteKeys(SMCKeyInfoCache_t *cache,
+                                 const SMCTransport_t *transport,
+                                 const SMCVal_t *vals, SMCResult_t *results,
+                                 const size_t n, const io_connect_t conn) {
+  if (n == 0) {
+    return kIOReturnSuccess;
+  }
+  if (vals == NULL || results == NULL) {
+    return kIOReturnBadArgument;
+  }
+
+  SMCKeyData_t inputStructure;
+  SMCKeyData_t outputStructure;
+
+  memset(&inputStructure, 0, sizeof(SMCKeyData_t));
+  memset(&outputStructure, 0, sizeof(SMCKeyData_t));
+  inputStructure.data8 = SMC_CMD_WRITE_KEY;
+
+  for (size_t i = 0; i < n; i++) {
+    SMCKeyData_keyInfo_t keyInfo;
+    const UInt32 keyCode = FourCharCodeFromString(&vals[i].key);
+
+    results[i] =
+        SMCCachedGetKeyInfo(cache, transport, keyCode, &keyInfo, conn);
+    if (results[i].kern_res != kIOReturnSuccess ||
+        results[i].smc_res != kSMCReturnSuccess) {
+      continue;
+    }
+
+    if (keyInfo.dataSize != vals[i].dataSize ||
+        keyInfo.dataType != FourCharCodeFromString(&vals[i].dataType)) {
+      results[i].kern_res = kIOReturnBadArgument;
+      results[i].smc_res = kSMCReturnDataTypeMismatch;
+      continue;
+    }
+
+    inputStructure.key = keyCode;
+    inputStructure.keyInfo.dataSize = vals[i].dataSize;
+    memcpy(inputStructure.bytes, vals[i].bytes, sizeof(vals[i].bytes));
+
+    results[i].kern_res =
+        SMCTransportCall(transport, SMC_KERNEL_INDEX, &inputStructure,
+                         &outputStructure, conn);
+    results[i].smc_res = outputStructure.result;
+  }
+
+  return kIOReturnSuccess;
+}
+
+kern_return_t SMCWriteKeys(const SMCVal_t *vals, SMCResult_t *results,
+                           const size_t n, const io_connect_t conn) {
+  return SMCCachedWriteKeys(SMCSharedKeyInfoCache(), NULL, vals, results, n,
+                            conn);
+}
+
+SMCResult_t SMCCachedGetKeyFromIndex(SMCKeyInfoCache_t *cache,
+                                     const SMCTransport_t *transport,
+                                     const UInt32 index, UInt32Char_t *key,
+                                     const io_connect_t conn) {
   SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
 
   if (key == NULL) {
     return result;
   }
 
+  const UInt32 cached = SMCKeyInfoCacheIndexLookup(cache, index);
+  if (cached != 0) {
+    StringFromFourCharCode(cached, key);
+    result.kern_res = kIOReturnSuccess;
+    result.smc_res = kSMCReturnSuccess;
+    return result;
+  }
+
   SMCKeyData_t inputStructure;
   SMCKeyData_t outputStructure;
 
@@ -201,7 +275,8 @@ SMCResult_t SMCGetKeyFromIndex(const UInt32 index, UInt32Char_t *key,
   inputStructure.data32 = index;
 
   result.kern_res =
-      SMCCall(SMC_KERNEL_INDEX, &inputStructure, &outputStructure, conn);
+      SMCTransportCall(transport, SMC_KERNEL_INDEX, &inputStructure,
+                       &outputStructure, conn);
   result.smc_res = outputStructure.result;
   if (result.kern_res != kIOReturnSuccess ||
       result.smc_res != kSMCReturnSuccess) {
@@ -209,35 +284,154 @@ SMCResult_t SMCGetKeyFromIndex(const UInt32 index, UInt32Char_t *key,
   }
 
   StringFromFourCharCode(outputStructure.key, key);
+  SMCKeyInfoCacheIndexStore(cache, index, outputStructure.key);
 
   return result;
 }
 
-SMCResult_t SMCGetKeyInfo(const UInt32 key, SMCKeyData_keyInfo_t *keyInfo,
-                          const io_connect_t conn) {
+SMCResult_t SMCGetKeyFromIndex(const UInt32 index, UInt32Char_t *key,
+                               const io_connect_t conn) {
+  return SMCCachedGetKeyFromIndex(SMCSharedKeyInfoCache(), NULL, index, key,
+                                  conn);
+}
+
+SMCResult_t SMCTransportReadVersion(const SMCTransport_t *transport,
+                                    SMCKeyData_vers_t *vers,
+                                    const io_connect_t conn) {
   SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
 
-  if (keyInfo == NULL) {
+  if (vers == NULL) {
     return result;
   }
 
-  pthread_once(&g_cacheInitOnce, init_cache);
+  SMCKeyData_t inputStructure;
+  SMCKeyData_t outputStructure;
+
+  memset(&inputStructure, 0, sizeof(SMCKeyData_t));
+  memset(&outputStructure, 0, sizeof(SMCKeyData_t));
 
-  pthread_mutex_lock(&g_keyInfoCacheLock);
+  inputStructure.data8 = SMC_CMD_READ_VERSION;
 
-  khint_t k = mapKeyInfo_get(g_keyInfoCache, key);
-  if (k != kh_end(g_keyInfoCache)) {
-    *keyInfo = kh_val(g_keyInfoCache, k);
-    pthread_mutex_unlock(&g_keyInfoCacheLock);
+  result.kern_res =
+      SMCTransportCall(transport, SMC_KERNEL_INDEX, &inputStructure,
+                       &outputStructure, conn);
+  result.smc_res = outputStructure.result;
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    return result;
+  }
 
-    // Returning from cache so set to success
+  *vers = outputStructure.vers;
+  return result;
+}
+
+SMCResult_t SMCReadVersion(SMCKeyData_vers_t *vers, const io_connect_t conn) {
+  return SMCTransportReadVersion(NULL, vers, conn);
+}
+
+SMCResult_t SMCCachedReadVersion(SMCKeyInfoCache_t *cache,
+                                 const SMCTransport_t *transport,
+                                 SMCKeyData_vers_t *vers,
+                                 const io_connect_t conn) {
+  SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
+
+  if (vers == NULL) {
+    return result;
+  }
+
+  if (SMCKeyInfoCacheVersion(cache, vers)) {
+    result.kern_res = kIOReturnSuccess;
+    result.smc_res = kSMCReturnSuccess;
+    return result;
+  }
+
+  result = SMCTransportReadVersion(transport, vers, conn);
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    return result;
+  }
+
+  SMCKeyInfoCacheSetVersion(cache, vers);
+  return result;
+}
+
+SMCResult_t SMCTransportReadPowerLimits(const SMCTransport_t *transport,
+                                        SMCKeyData_pLimitData_t *limits,
+                                        const io_connect_t conn) {
+  SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
+
+  if (limits == NULL) {
+    return result;
+  }
+
+  SMCKeyData_t inputStructure;
+  SMCKeyData_t outputStructure;
+
+  memset(&inputStructure, 0, sizeof(SMCKeyData_t));
+  memset(&outputStructure, 0, sizeof(SMCKeyData_t));
+
+  inputStructure.data8 = SMC_CMD_READ_POWER_LIMIT;
+
+  result.kern_res =
+      SMCTransportCall(transport, SMC_KERNEL_INDEX, &inputStructure,
+                       &outputStructure, conn);
+  result.smc_res = outputStructure.result;
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    return result;
+  }
+
+  *limits = outputStructure.pLimitData;
+  return result;
+}
+
+SMCResult_t SMCReadPowerLimits(SMCKeyData_pLimitData_t *limits,
+                               const io_connect_t conn) {
+  return SMCTransportReadPowerLimits(NULL, limits, conn);
+}
+
+SMCResult_t SMCCachedGetKeyCount(SMCKeyInfoCache_t *cache,
+                                 const SMCTransport_t *transport,
+                                 UInt32 *count, const io_connect_t conn) {
+  SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
+
+  if (count == NULL) {
+    return result;
+  }
+
+  if (SMCKeyInfoCacheIndexCount(cache, count)) {
     result.kern_res = kIOReturnSuccess;
     result.smc_res = kSMCReturnSuccess;
     return result;
   }
 
-  pthread_mutex_unlock(&g_keyInfoCacheLock);
+  const UInt32Char_t key = {{'#', 'K', 'E', 'Y', '\0'}};
+  SMCVal_t val;
+
+  result = SMCCachedReadKey(cache, transport, &key, &val, conn);
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    return result;
+  }
+
+  // #KEY is one of the few keys stored big-endian
+  *count = ((UInt32)val.bytes[0] << 24) | ((UInt32)val.bytes[1] << 16) |
+           ((UInt32)val.bytes[2] << 8) | ((UInt32)val.bytes[3]);
+
+  SMCKeyInfoCacheIndexCreate(cache, *count);
+  return result;
+}
+
+SMCResult_t SMCGetKeyCount(UInt32 *count, const io_connect_t conn) {
+  return SMCCachedGetKeyCount(SMCSharedKeyInfoCache(), NULL, count, conn);
+}
 
+// Asks the SMC for a key's info, bypassing the cache.
+static SMCResult_t fetch_key_info(const SMCTransport_t *transport,
+                                  const UInt32 key,
+                                  SMCKeyData_keyInfo_t *keyInfo,
+                                  const io_connect_t conn) {
+  SMCResult_t result;
   SMCKeyData_t inputStructure;
   SMCKeyData_t outputStructure;
 
@@ -248,7 +442,8 @@ SMCResult_t SMCGetKeyInfo(const UInt32 key, SMCKeyData_keyInfo_t *keyInfo,
   inputStructure.data8 = SMC_CMD_READ_KEY_INFO;
 
   result.kern_res =
-      SMCCall(SMC_KERNEL_INDEX, &inputStructure, &outputStructure, conn);
+      SMCTransportCall(transport, SMC_KERNEL_INDEX, &inputStructure,
+                       &outputStructure, conn);
   result.smc_res = outputStructure.result;
   if (result.kern_res != kIOReturnSuccess ||
       result.smc_res != kSMCReturnSuccess) {
@@ -256,22 +451,299 @@ SMCResult_t SMCGetKeyInfo(const UInt32 key, SMCKeyData_keyInfo_t *keyInfo,
   }
 
   *keyInfo = outputStructure.keyInfo;
+  return result;
+}
 
-  pthread_mutex_lock(&g_keyInfoCacheLock);
+SMCResult_t SMCCachedGetKeyInfo(SMCKeyInfoCache_t *cache,
+                                const SMCTransport_t *transport,
+                                const UInt32 key,
+                                SMCKeyData_keyInfo_t *keyInfo,
+                                const io_connect_t conn) {
+  SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
 
-  int absent;
-  k = mapKeyInfo_put(g_keyInfoCache, key, &absent);
-  if (absent) {
-    kh_val(g_keyInfoCache, k) = outputStructure.keyInfo;
+  if (keyInfo == NULL) {
+    return result;
   }
 
-  pthread_mutex_unlock(&g_keyInfoCacheLock);
+  switch (SMCKeyInfoCacheLookup(cache, key, keyInfo)) {
+  case CACHE_HIT:
+    SMCStatsCount(SMC_STAT_CACHE_HIT);
+    // Returning from cache so set to success
+    result.kern_res = kIOReturnSuccess;
+    result.smc_res = kSMCReturnSuccess;
+    return result;
+  case CACHE_ABSENT:
+    SMCStatsCount(SMC_STAT_CACHE_ABSENT_HIT);
+    result.kern_res = kIOReturnSuccess;
+    result.smc_res = kSMCReturnKeyNotFound;
+    return result;
+  case CACHE_MISS:
+    SMCStatsCount(SMC_STAT_CACHE_MISS);
+    break;
+  }
+
+  result = fetch_key_info(transport, key, keyInfo, conn);
+  if (result.kern_res == kIOReturnSuccess &&
+      result.smc_res == kSMCReturnKeyNotFound) {
+    SMCKeyInfoCacheInsert(cache, key, NULL);
+    return result;
+  }
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    return result;
+  }
+
+  SMCKeyInfoCacheInsert(cache, key, keyInfo);
 
   return result;
 }
 
+SMCResult_t SMCGetKeyInfo(const UInt32 key, SMCKeyData_keyInfo_t *keyInfo,
+                          const io_connect_t conn) {
+  return SMCCachedGetKeyInfo(SMCSharedKeyInfoCache(), NULL, key, keyInfo,
+                             conn);
+}
+
+SMCResult_t SMCCachedIsKeyFound(SMCKeyInfoCache_t *cache,
+                                const SMCTransport_t *transport,
+                                const UInt32 key, bool *found,
+                                const io_connect_t conn) {
+  SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
+
+  if (found == NULL) {
+    return result;
+  }
+
+  SMCKeyData_keyInfo_t keyInfo;
+  result = SMCCachedGetKeyInfo(cache, transport, key, &keyInfo, conn);
+  if (result.kern_res == kIOReturnSuccess &&
+      result.smc_res == kSMCReturnKeyNotFound) {
+    // A missing key is an answer, not an error
+    *found = false;
+    result.smc_res = kSMCReturnSuccess;
+    return result;
+  }
+
+  *found = result.kern_res == kIOReturnSuccess &&
+           result.smc_res == kSMCReturnSuccess;
+  return result;
+}
+
+SMCResult_t SMCIsKeyFound(const UInt32 key, bool *found,
+                          const io_connect_t conn) {
+  return SMCCachedIsKeyFound(SMCSharedKeyInfoCache(), NULL, key, found, conn);
+}
+
+SMCResult_t SMCCachedResolveKey(SMCKeyInfoCache_t *cache,
+                                const SMCTransport_t *transport,
+                                const UInt32Char_t *key,
+                                SMCKeyHandle_t *handle,
+                                const io_connect_t conn) {
+  SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
+
+  if (key == NULL || handle == NULL) {
+    return result;
+  }
+
+  SMCKeyData_keyInfo_t keyInfo;
+  const UInt32 keyCode = FourCharCodeFromString(key);
+
+  result = SMCCachedGetKeyInfo(cache, transport, keyCode, &keyInfo, conn);
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    return result;
+  }
+
+  handle->key = keyCode;
+  handle->dataSize = keyInfo.dataSize;
+  handle->dataType = keyInfo.dataType;
+  return result;
+}
+
+SMCResult_t SMCResolveKey(const UInt32Char_t *key, SMCKeyHandle_t *handle,
+                          const io_connect_t conn) {
+  return SMCCachedResolveKey(SMCSharedKeyInfoCache(), NULL, key, handle,
+                             conn);
+}
+
+SMCResult_t SMCTransportReadKeyResolved(const SMCTransport_t *transport,
+                                        const SMCKeyHandle_t *handle,
+                                        SMCVal_t *val,
+                                        const io_connect_t conn) {
+  SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
+
+  if (handle == NULL || val == NULL) {
+    return result;
+  }
+
+  SMCKeyData_t inputStructure;
+  SMCKeyData_t outputStructure;
+
+  memset(&inputStructure, 0, sizeof(SMCKeyData_t));
+  memset(&outputStructure, 0, sizeof(SMCKeyData_t));
+  memset(val, 0, sizeof(SMCVal_t));
+
+  StringFromFourCharCode(handle->key, &val->key);
+  val->dataSize = handle->dataSize;
+  StringFromFourCharCode(handle->dataType, &val->dataType);
+
+  inputStructure.key = handle->key;
+  inputStructure.keyInfo.dataSize = handle->dataSize;
+  inputStructure.data8 = SMC_CMD_READ_KEY;
+
+  result.kern_res =
+      SMCTransportCall(transport, SMC_KERNEL_INDEX, &inputStructure,
+                       &outputStructure, conn);
+  result.smc_res = outputStructure.result;
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    return result;
+  }
+
+  memcpy(val->bytes, outputStructure.bytes, sizeof(outputStructure.bytes));
+  return result;
+}
+
+SMCResult_t SMCReadKeyResolved(const SMCKeyHandle_t *handle, SMCVal_t *val,
+                               const io_connect_t conn) {
+  return SMCTransportReadKeyResolved(NULL, handle, val, conn);
+}
+
+SMCResult_t SMCTransportWriteKeyResolved(const SMCTransport_t *transport,
+                                         const SMCKeyHandle_t *handle,
+                                         const SMCVal_t *val,
+                                         const io_connect_t conn) {
+  SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
+
+  if (handle == NULL || val == NULL) {
+    return result;
+  }
+
+  SMCKeyData_t inputStructure;
+  SMCKeyData_t outputStructure;
+
+  memset(&inputStructure, 0, sizeof(SMCKeyData_t));
+  memset(&outputStructure, 0, sizeof(SMCKeyData_t));
+
+  inputStructure.key = handle->key;
+  inputStructure.data8 = SMC_CMD_WRITE_KEY;
+  inputStructure.keyInfo.dataSize = handle->dataSize;
+  memcpy(inputStructure.bytes, val->bytes, sizeof(val->bytes));
+
+  result.kern_res =
+      SMCTransportCall(transport, SMC_KERNEL_INDEX, &inputStructure,
+                       &outputStructure, conn);
+  result.smc_res = outputStructure.result;
+  return result;
+}
+
+SMCResult_t SMCWriteKeyResolved(const SMCKeyHandle_t *handle,
+                                const SMCVal_t *val, const io_connect_t conn) {
+  return SMCTransportWriteKeyResolved(NULL, handle, val, conn);
+}
+
+kern_return_t SMCCachedReadKeys(SMCKeyInfoCache_t *cache,
+                                const SMCTransport_t *transport,
+                                const UInt32Char_t *keys, SMCVal_t *vals,
+                                SMCResult_t *results, const size_t n,
+                                const io_connect_t conn) {
+  if (n == 0) {
+    return kIOReturnSuccess;
+  }
+  if (keys == NULL || vals == NULL || results == NULL) {
+    return kIOReturnBadArgument;
+  }
+
+  // Resolve every key's info from the cache first. The key info is parked in
+  // vals[i] and results[i] records whether it was found.
+  size_t misses = 0;
+  for (size_t i = 0; i < n; i++) {
+    SMCKeyData_keyInfo_t keyInfo;
+    const UInt32 keyCode = FourCharCodeFromString(&keys[i]);
+
+    memset(&vals[i], 0, sizeof(SMCVal_t));
+    StringFromFourCharCode(keyCode, &vals[i].key);
+
+    switch (SMCKeyInfoCacheLookup(cache, keyCode, &keyInfo)) {
+    case CACHE_HIT:
+      SMCStatsCount(SMC_STAT_CACHE_HIT);
+      vals[i].dataSize = keyInfo.dataSize;
+      StringFromFourCharCode(keyInfo.dataType, &vals[i].dataType);
+      results[i].kern_res = kIOReturnSuccess;
+      results[i].smc_res = kSMCReturnSuccess;
+      break;
+    case CACHE_ABSENT:
+      SMCStatsCount(SMC_STAT_CACHE_ABSENT_HIT);
+      results[i].kern_res = kIOReturnSuccess;
+      results[i].smc_res = kSMCReturnKeyNotFound;
+      break;
+    case CACHE_MISS:
+      // Counted by SMCGetKeyInfo below.
+      results[i].kern_res = kIOReturnNotFound;
+      results[i].smc_res = kSMCReturnError;
+      misses++;
+      break;
+    }
+  }
+
+  // Misses go through the regular path, which fetches and caches them.
+  for (size_t i = 0; misses > 0 && i < n; i++) {
+    if (results[i].kern_res != kIOReturnNotFound) {
+      continue;
+    }
+
+    SMCKeyData_keyInfo_t keyInfo;
+    results[i] =
+        SMCCachedGetKeyInfo(cache, transport,
+                            FourCharCodeFromString(&vals[i].key), &keyInfo,
+                            conn);
+    if (results[i].kern_res == kIOReturnSuccess &&
+        results[i].smc_res == kSMCReturnSuccess) {
+      vals[i].dataSize = keyInfo.dataSize;
+      StringFromFourCharCode(keyInfo.dataType, &vals[i].dataType);
+    }
+    misses--;
+  }
+
+  SMCKeyData_t inputStructure;
+  SMCKeyData_t outputStructure;
+
+  memset(&inputStructure, 0, sizeof(SMCKeyData_t));
+  memset(&outputStructure, 0, sizeof(SMCKeyData_t));
+  inputStructure.data8 = SMC_CMD_READ_KEY;
+
+  for (size_t i = 0; i < n; i++) {
+    if (results[i].kern_res != kIOReturnSuccess ||
+        results[i].smc_res != kSMCReturnSuccess) {
+      continue;
+    }
+
+    inputStructure.key = FourCharCodeFromString(&vals[i].key);
+    inputStructure.keyInfo.dataSize = vals[i].dataSize;
+
+    results[i].kern_res =
+        SMCTransportCall(transport, SMC_KERNEL_INDEX, &inputStructure,
+                         &outputStructure, conn);
+    results[i].smc_res = outputStructure.result;
+    if (results[i].kern_res != kIOReturnSuccess ||
+        results[i].smc_res != kSMCReturnSuccess) {
+      continue;
+    }
+
+    memcpy(vals[i].bytes, outputStructure.bytes,
+           sizeof(outputStructure.bytes));
+  }
+
+  return kIOReturnSuccess;
+}
+
+kern_return_t SMCReadKeys(const UInt32Char_t *keys, SMCVal_t *vals,
+                          SMCResult_t *results, const size_t n,
+                          const io_connect_t conn) {
+  return SMCCachedReadKeys(SMCSharedKeyInfoCache(), NULL, keys, vals, results,
+                           n, conn);
+}
+
 void SMCCleanupCache(void) {
-  pthread_mutex_lock(&g_keyInfoCacheLock);
-  destroy_cache();
-  pthread_mutex_unlock(&g_keyInfoCacheLock);
+  SMCKeyInfoCacheClear(SMCSharedKeyInfoCache());
 }
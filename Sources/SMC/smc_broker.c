@@ -0,0 +1,430 @@
+/*
+ MIT License
+
+ Copyright (c) 2025 Sriman Achanta
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "khashl.h"
+#include "smc.h"
+#include "smc_internal.h"
+
+#define BROKER_MAGIC 0x534D4342 // 'SMCB'
+#define BROKER_FORMAT 1
+#define BROKER_DEFAULT_CAPACITY 256
+// Far more keys than any SMC reports, and small enough that the slot count
+// can't overflow.
+#define BROKER_MAX_CAPACITY 65536
+// A reader that keeps landing on a write gives up rather than spin forever on
+// a publisher that died mid-write.
+#define BROKER_READ_RETRIES 1024
+
+// magic is stored last, so a client never maps a table that is still being
+// set up. generation tells apart successive brokers published under the same
+// name.
+typedef struct {
+  _Atomic UInt32 magic;
+  UInt32 format;
+  UInt32 slotCount; // a power of two
+  UInt32 capacity;  // the most keys the publisher will add
+  _Atomic UInt32 count;
+  _Atomic UInt32 retired;
+  UInt64 generation;
+  UInt8 reserved[32];
+} BrokerHeader;
+
+// One cache line per key. key is set once, when the publisher first adds the
+// key, and never cleared. The rest is guarded by seq, which is odd while the
+// publisher is writing and 0 until the first write. Every field is atomic so
+// a reader racing a write sees torn values rather than undefined behaviour,
+// and then retries because seq moved.
+typedef struct {
+  _Atomic UInt32 seq;
+  _Atomic UInt32 key;
+  _Atomic UInt32 dataType;
+  _Atomic UInt32 dataSize;
+  _Atomic kern_return_t kernRes;
+  _Atomic UInt32 smcRes;
+  _Atomic UInt64 timestamp;
+  _Atomic UInt64 bytes[sizeof(SMCBytes_t) / sizeof(UInt64)];
+} BrokerSlot;
+
+_Static_assert(sizeof(BrokerHeader) == 64, "broker header layout");
+_Static_assert(sizeof(BrokerSlot) == 64, "broker slot layout");
+
+struct SMCBroker {
+  void *map;
+  size_t size;
+  BrokerHeader *header;
+  BrokerSlot *slots;
+  // Set for the publisher, which also serializes its writers with lock.
+  char *name;
+  pthread_mutex_t lock;
+};
+
+static kern_return_t errno_result(const int error) {
+  switch (error) {
+  case ENOENT:
+    return kIOReturnNotFound;
+  case EACCES:
+  case EPERM:
+    return kIOReturnNotPrivileged;
+  case EINVAL:
+  case ENAMETOOLONG:
+    return kIOReturnBadArgument;
+  case ENOMEM:
+  case ENOSPC:
+    return kIOReturnNoMemory;
+  default:
+    return kIOReturnError;
+  }
+}
+
+static size_t broker_size(const UInt32 slotCount) {
+  return sizeof(BrokerHeader) + (size_t)slotCount * sizeof(BrokerSlot);
+}
+
+// The smallest power-of-two slot count that holds capacity keys at a load
+// factor of 3/4.
+static UInt32 slot_count_for(const UInt32 capacity) {
+  UInt32 slots = 16;
+  while (slots - slots / 4 < capacity) {
+    slots <<= 1;
+  }
+  return slots;
+}
+
+// The slot holding key, or the free slot ending its probe run, or NULL if the
+// table is full.
+static BrokerSlot *find_slot(BrokerSlot *slots, const UInt32 slotCount,
+                             const UInt32 key) {
+  const UInt32 mask = slotCount - 1;
+  UInt32 i = kh_hash_uint32(key) & mask;
+
+  for (UInt32 probes = 0; probes < slotCount; probes++, i = (i + 1) & mask) {
+    const UInt32 slotKey =
+        atomic_load_explicit(&slots[i].key, memory_order_acquire);
+    if (slotKey == key || slotKey == 0) {
+      return &slots[i];
+    }
+  }
+  return NULL;
+}
+
+static SMCBroker_t *broker_alloc(void *map, const size_t size) {
+  SMCBroker_t *broker = calloc(1, sizeof(SMCBroker_t));
+  if (broker == NULL) {
+    return NULL;
+  }
+
+  broker->map = map;
+  broker->size = size;
+  broker->header = map;
+  broker->slots = (BrokerSlot *)((char *)map + sizeof(BrokerHeader));
+  return broker;
+}
+
+kern_return_t SMCBrokerCreate(const char *name, UInt32 capacity,
+                              SMCBroker_t **broker) {
+  if (name == NULL || broker == NULL) {
+    return kIOReturnBadArgument;
+  }
+  *broker = NULL;
+
+  if (capacity == 0) {
+    capacity = BROKER_DEFAULT_CAPACITY;
+  }
+  if (capacity > BROKER_MAX_CAPACITY) {
+    return kIOReturnBadArgument;
+  }
+  const UInt32 slotCount = slot_count_for(capacity);
+  const size_t size = broker_size(slotCount);
+
+  // Replace whatever is published under name, e.g. by a publisher that
+  // crashed. Clients still mapping the old table see it go stale.
+  // Readable by the publisher's user only; readers in other processes run as
+  // the same user.
+  shm_unlink(name);
+  const int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    return errno_result(errno);
+  }
+  if (ftruncate(fd, (off_t)size) != 0) {
+    const int error = errno;
+    close(fd);
+    shm_unlink(name);
+    return errno_result(error);
+  }
+
+  void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    shm_unlink(name);
+    return kIOReturnIOError;
+  }
+
+  SMCBroker_t *created = broker_alloc(map, size);
+  if (created != NULL) {
+    created->name = strdup(name);
+  }
+  if (created == NULL || created->name == NULL) {
+    free(created);
+    munmap(map, size);
+    shm_unlink(name);
+    return kIOReturnNoMemory;
+  }
+  pthread_mutex_init(&created->lock, NULL);
+
+  BrokerHeader *header = created->header;
+  header->format = BROKER_FORMAT;
+  header->slotCount = slotCount;
+  header->capacity = capacity;
+  header->generation =
+      clock_gettime_nsec_np(CLOCK_UPTIME_RAW) ^ ((UInt64)getpid() << 32);
+  atomic_store_explicit(&header->magic, BROKER_MAGIC, memory_order_release);
+
+  *broker = created;
+  return kIOReturnSuccess;
+}
+
+kern_return_t SMCBrokerOpen(const char *name, SMCBroker_t **broker) {
+  if (name == NULL || broker == NULL) {
+    return kIOReturnBadArgument;
+  }
+  *broker = NULL;
+
+  const int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    return errno_result(errno);
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BrokerHeader)) {
+    close(fd);
+    return kIOReturnBadMedia;
+  }
+
+  const size_t size = (size_t)st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return kIOReturnIOError;
+  }
+
+  const BrokerHeader *header = map;
+  const UInt32 slotCount = header->slotCount;
+  const int valid =
+      atomic_load_explicit(&header->magic, memory_order_acquire) ==
+          BROKER_MAGIC &&
+      header->format == BROKER_FORMAT && slotCount != 0 &&
+      (slotCount & (slotCount - 1)) == 0 && size >= broker_size(slotCount);
+
+  SMCBroker_t *opened = valid ? broker_alloc(map, size) : NULL;
+  if (opened == NULL) {
+    munmap(map, size);
+    return valid ? kIOReturnNoMemory : kIOReturnBadMedia;
+  }
+
+  *broker = opened;
+  return kIOReturnSuccess;
+}
+
+// Unlinks name unless another publisher has taken it over since.
+static void unlink_if_ours(const char *name, const UInt64 generation) {
+  const int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    return;
+  }
+
+  void *map = mmap(NULL, sizeof(BrokerHeader), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return;
+  }
+
+  const int ours = ((const BrokerHeader *)map)->generation == generation;
+  munmap(map, sizeof(BrokerHeader));
+  if (ours) {
+    shm_unlink(name);
+  }
+}
+
+void SMCBrokerClose(SMCBroker_t *broker) {
+  if (broker == NULL) {
+    return;
+  }
+
+  if (broker->name != NULL) {
+    atomic_store_explicit(&broker->header->retired, 1, memory_order_release);
+    unlink_if_ours(broker->name, broker->header->generation);
+    pthread_mutex_destroy(&broker->lock);
+    free(broker->name);
+  }
+
+  munmap(broker->map, broker->size);
+  free(broker);
+}
+
+kern_return_t SMCBrokerPublish(SMCBroker_t *broker, const SMCVal_t *val,
+                               const SMCResult_t result,
+                               const UInt64 timestamp) {
+  if (broker == NULL || broker->name == NULL || val == NULL) {
+    return kIOReturnBadArgument;
+  }
+
+  const UInt32 key = FourCharCodeFromString(&val->key);
+  if (key == 0) {
+    return kIOReturnBadArgument;
+  }
+
+  BrokerHeader *header = broker->header;
+
+  pthread_mutex_lock(&broker->lock);
+
+  BrokerSlot *slot = find_slot(broker->slots, header->slotCount, key);
+  if (slot != NULL &&
+      atomic_load_explicit(&slot->key, memory_order_relaxed) == 0) {
+    if (atomic_load_explicit(&header->count, memory_order_relaxed) >=
+        header->capacity) {
+      slot = NULL;
+    } else {
+      atomic_store_explicit(&slot->key, key, memory_order_release);
+      atomic_fetch_add_explicit(&header->count, 1, memory_order_relaxed);
+    }
+  }
+  if (slot == NULL) {
+    pthread_mutex_unlock(&broker->lock);
+    return kIOReturnNoSpace;
+  }
+
+  UInt64 bytes[sizeof(SMCBytes_t) / sizeof(UInt64)];
+  memcpy(bytes, val->bytes, sizeof(bytes));
+
+  const UInt32 seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+  atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  atomic_store_explicit(&slot->dataType,
+                        FourCharCodeFromString(&val->dataType),
+                        memory_order_relaxed);
+  atomic_store_explicit(&slot->dataSize, val->dataSize, memory_order_relaxed);
+  atomic_store_explicit(&slot->kernRes, result.kern_res,
+                        memory_order_relaxed);
+  atomic_store_explicit(&slot->smcRes, result.smc_res, memory_order_relaxed);
+  atomic_store_explicit(&slot->timestamp, timestamp, memory_order_relaxed);
+  for (size_t i = 0; i < sizeof(bytes) / sizeof(UInt64); i++) {
+    atomic_store_explicit(&slot->bytes[i], bytes[i], memory_order_relaxed);
+  }
+
+  atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+
+  pthread_mutex_unlock(&broker->lock);
+  return kIOReturnSuccess;
+}
+
+SMCResult_t SMCBrokerRead(const SMCBroker_t *broker, const UInt32Char_t *key,
+                          SMCVal_t *val, UInt64 *timestamp) {
+  SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
+
+  if (broker == NULL || key == NULL || val == NULL) {
+    return result;
+  }
+
+  const UInt32 keyCode = FourCharCodeFromString(key);
+  BrokerSlot *slot =
+      keyCode != 0
+          ? find_slot(broker->slots, broker->header->slotCount, keyCode)
+          : NULL;
+
+  result.kern_res = kIOReturnSuccess;
+  result.smc_res = kSMCReturnKeyNotFound;
+  if (slot == NULL ||
+      atomic_load_explicit(&slot->key, memory_order_relaxed) != keyCode) {
+    return result;
+  }
+
+  for (int attempt = 0; attempt < BROKER_READ_RETRIES; attempt++) {
+    const UInt32 seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq == 0) {
+      return result;
+    }
+    if (seq & 1) {
+      continue;
+    }
+
+    const UInt32 dataType =
+        atomic_load_explicit(&slot->dataType, memory_order_relaxed);
+    const UInt32 dataSize =
+        atomic_load_explicit(&slot->dataSize, memory_order_relaxed);
+    const kern_return_t kernRes =
+        atomic_load_explicit(&slot->kernRes, memory_order_relaxed);
+    const UInt32 smcRes =
+        atomic_load_explicit(&slot->smcRes, memory_order_relaxed);
+    const UInt64 stamp =
+        atomic_load_explicit(&slot->timestamp, memory_order_relaxed);
+    UInt64 bytes[sizeof(SMCBytes_t) / sizeof(UInt64)];
+    for (size_t i = 0; i < sizeof(bytes) / sizeof(UInt64); i++) {
+      bytes[i] = atomic_load_explicit(&slot->bytes[i], memory_order_relaxed);
+    }
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+      continue;
+    }
+
+    memset(val, 0, sizeof(SMCVal_t));
+    val->key = *key;
+    val->dataSize = dataSize;
+    StringFromFourCharCode(dataType, &val->dataType);
+    memcpy(val->bytes, bytes, sizeof(bytes));
+    if (timestamp != NULL) {
+      *timestamp = stamp;
+    }
+
+    result.kern_res = kernRes;
+    result.smc_res = (smc_return_t)smcRes;
+    return result;
+  }
+
+  result.kern_res = kIOReturnBusy;
+  result.smc_res = kSMCReturnError;
+  return result;
+}
+
+UInt32 SMCBrokerCount(const SMCBroker_t *broker) {
+  return broker != NULL ? atomic_load_explicit(&broker->header->count,
+                                               memory_order_relaxed)
+                        : 0;
+}
+
+bool SMCBrokerRetired(const SMCBroker_t *broker) {
+  return broker == NULL ||
+         atomic_load_explicit(&broker->header->retired, memory_order_acquire);
+}
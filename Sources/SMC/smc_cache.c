@@ -0,0 +1,689 @@
+/*
+ MIT License
+
+ Copyright (c) 2025 Sriman Achanta
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "khashl.h"
+#include "smc.h"
+#include "smc_internal.h"
+
+#define KEY_INFO_CACHE_INITIAL_CAPACITY 4096
+// A frozen bucket holds the keys of one cache line.
+#define FROZEN_BUCKET_KEYS 16
+// Frozen tables start at about this many keys per bucket and double their
+// bucket count until no bucket overflows.
+#define FROZEN_TARGET_LOAD 4
+#define FROZEN_MAX_BUCKETS (1u << 20)
+// The cached firmware version is packed into the low bytes of a word, with
+// VERSION_CACHED set once it holds one, so readers need no lock.
+#define VERSION_CACHED ((UInt64)1 << 63)
+
+_Static_assert(sizeof(SMCKeyData_vers_t) < sizeof(UInt64),
+               "SMCKeyData_vers_t must fit beside the cached flag");
+
+// A key info cache is an open-addressing table that is read without locks.
+// Inserts and evictions are serialized by the cache's lock and publish a slot
+// by storing its key last, so a reader that sees the key also sees the info. A
+// slot's key doubles as a sequence number: readers re-check it after copying
+// the info and treat a change (from a concurrent clear, eviction or reuse) as
+// a miss. A reader racing an eviction may also miss a key that is being
+// shifted back into the freed slot; it then fetches the key again.
+//
+// Keys the SMC reports as missing are cached too, so probing for absent keys
+// doesn't go back to the SMC every time.
+typedef struct {
+  _Atomic UInt32 key; // 0 marks an empty slot
+  _Atomic UInt32 dataSize;
+  _Atomic UInt32 dataType;
+  _Atomic UInt8 dataAttributes;
+  _Atomic UInt8 absent;
+  _Atomic UInt8 referenced; // set on every hit, cleared by the clock hand
+} KeyInfoSlot;
+
+typedef struct KeyInfoTable {
+  UInt32 mask;
+  UInt32 count;
+  // Tables replaced by a resize stay alive because readers may still be
+  // probing them. Capacity doubles on every resize, so the retired tables
+  // never take more memory than the live one.
+  struct KeyInfoTable *retired;
+  KeyInfoSlot slots[];
+} KeyInfoTable;
+
+// A read-only table of a complete key set, built once the keys have been
+// enumerated. Each key hashes to one bucket, a cache line of keys that is
+// compared in full with no early exit, so a lookup is a single line load and
+// a loop the compiler turns into vector compares. The info sits in a parallel
+// array at the same position. Frozen tables are never written after they are
+// published, so readers need no atomics beyond loading the pointer.
+typedef struct {
+  _Alignas(64) UInt32 keys[FROZEN_BUCKET_KEYS]; // 0 marks an empty position
+} FrozenBucket;
+
+typedef struct FrozenKeyInfo {
+  UInt32 mask;
+  SMCKeyData_keyInfo_t *infos;
+  // Like KeyInfoTable.retired: a replaced or cleared frozen table stays alive
+  // until the cache is destroyed, as readers may still be probing it.
+  struct FrozenKeyInfo *retired;
+  FrozenBucket *buckets;
+} FrozenKeyInfo;
+
+// The index-to-key table, sized from #KEY the first time the key count is
+// read and filled in as keys are enumerated. The key set is fixed for a given
+// firmware, so entries only go away when the cache is cleared. 0 marks an
+// index that hasn't been fetched yet.
+typedef struct KeyIndex {
+  UInt32 count;
+  // Like KeyInfoTable.retired: a cleared index stays alive until the cache is
+  // destroyed, as readers may still be using it.
+  struct KeyIndex *retired;
+  _Atomic UInt32 keys[];
+} KeyIndex;
+
+struct SMCKeyInfoCache {
+  _Atomic(KeyInfoTable *) table;
+  // Consulted before table; keys it doesn't hold fall through to table.
+  _Atomic(FrozenKeyInfo *) frozen;
+  // Frozen tables no longer published, waiting for the cache to be destroyed.
+  FrozenKeyInfo *retiredFrozen;
+  _Atomic(KeyIndex *) index;
+  // Indexes no longer published, waiting for the cache to be destroyed.
+  KeyIndex *retiredIndex;
+  _Atomic UInt64 version;
+  pthread_mutex_t lock;
+  // The most keys held at once, or 0 for no limit. Once full, each insert
+  // evicts a key that hasn't been hit since the clock hand last passed it.
+  UInt32 capacity;
+  UInt32 hand;
+};
+
+static void frozen_destroy(FrozenKeyInfo *frozen) {
+  free(frozen->buckets);
+  free(frozen->infos);
+  free(frozen);
+}
+
+// Finds a key in a frozen table and copies its info. Returns 0 if the key
+// isn't there.
+static int frozen_lookup(const FrozenKeyInfo *frozen, const UInt32 key,
+                         SMCKeyData_keyInfo_t *keyInfo) {
+  const UInt32 b = kh_hash_uint32(key) & frozen->mask;
+  const UInt32 *keys = frozen->buckets[b].keys;
+
+  UInt32 match = 0;
+  for (UInt32 i = 0; i < FROZEN_BUCKET_KEYS; i++) {
+    match |= (UInt32)(keys[i] == key) << i;
+  }
+  if (match == 0) {
+    return 0;
+  }
+
+  *keyInfo = frozen->infos[b * FROZEN_BUCKET_KEYS + __builtin_ctz(match)];
+  return 1;
+}
+
+// Fills a frozen table with bucketCount buckets, or returns NULL if a bucket
+// would overflow or memory runs out. overflow tells the two apart.
+static FrozenKeyInfo *frozen_create(const SMCKeyInfoEntry_t *entries,
+                                    const size_t n, const UInt32 bucketCount,
+                                    int *overflow) {
+  *overflow = 0;
+
+  FrozenKeyInfo *frozen = calloc(1, sizeof(FrozenKeyInfo));
+  UInt8 *fill = calloc(bucketCount, 1);
+  const size_t keys = (size_t)bucketCount * FROZEN_BUCKET_KEYS;
+  if (frozen != NULL) {
+    frozen->buckets = aligned_alloc(64, bucketCount * sizeof(FrozenBucket));
+    frozen->infos = calloc(keys, sizeof(SMCKeyData_keyInfo_t));
+  }
+  if (frozen == NULL || fill == NULL || frozen->buckets == NULL ||
+      frozen->infos == NULL) {
+    if (frozen != NULL) {
+      frozen_destroy(frozen);
+    }
+    free(fill);
+    return NULL;
+  }
+
+  memset(frozen->buckets, 0, bucketCount * sizeof(FrozenBucket));
+  frozen->mask = bucketCount - 1;
+
+  for (size_t i = 0; i < n; i++) {
+    const UInt32 key = entries[i].key;
+    if (key == 0) {
+      continue;
+    }
+
+    const UInt32 b = kh_hash_uint32(key) & frozen->mask;
+    if (fill[b] == FROZEN_BUCKET_KEYS) {
+      *overflow = 1;
+      frozen_destroy(frozen);
+      free(fill);
+      return NULL;
+    }
+
+    frozen->buckets[b].keys[fill[b]] = key;
+    frozen->infos[b * FROZEN_BUCKET_KEYS + fill[b]] = entries[i].keyInfo;
+    fill[b]++;
+  }
+
+  free(fill);
+  return frozen;
+}
+
+static SMCKeyInfoCache_t g_sharedKeyInfoCache = {
+    NULL, NULL, NULL, NULL, NULL, 0, PTHREAD_MUTEX_INITIALIZER, 0, 0};
+
+SMCKeyInfoCache_t *SMCSharedKeyInfoCache(void) { return &g_sharedKeyInfoCache; }
+
+SMCKeyInfoCache_t *SMCKeyInfoCacheCreate(const UInt32 capacity) {
+  SMCKeyInfoCache_t *cache = calloc(1, sizeof(SMCKeyInfoCache_t));
+  if (cache == NULL) {
+    return NULL;
+  }
+
+  atomic_init(&cache->table, NULL);
+  atomic_init(&cache->frozen, NULL);
+  atomic_init(&cache->index, NULL);
+  atomic_init(&cache->version, 0);
+  pthread_mutex_init(&cache->lock, NULL);
+  cache->capacity = capacity;
+  return cache;
+}
+
+void SMCKeyInfoCacheDestroy(SMCKeyInfoCache_t *cache) {
+  if (cache == NULL || cache == &g_sharedKeyInfoCache) {
+    return;
+  }
+
+  KeyInfoTable *table =
+      atomic_load_explicit(&cache->table, memory_order_relaxed);
+  while (table != NULL) {
+    KeyInfoTable *retired = table->retired;
+    free(table);
+    table = retired;
+  }
+
+  FrozenKeyInfo *frozen =
+      atomic_load_explicit(&cache->frozen, memory_order_relaxed);
+  if (frozen == NULL) {
+    frozen = cache->retiredFrozen;
+  }
+  while (frozen != NULL) {
+    FrozenKeyInfo *retired = frozen->retired;
+    frozen_destroy(frozen);
+    frozen = retired;
+  }
+
+  KeyIndex *index = atomic_load_explicit(&cache->index, memory_order_relaxed);
+  if (index == NULL) {
+    index = cache->retiredIndex;
+  }
+  while (index != NULL) {
+    KeyIndex *retired = index->retired;
+    free(index);
+    index = retired;
+  }
+
+  pthread_mutex_destroy(&cache->lock);
+  free(cache);
+}
+
+// Copies a slot's info and returns whether it marks an absent key.
+static UInt8 slot_load(const KeyInfoSlot *slot, SMCKeyData_keyInfo_t *keyInfo) {
+  keyInfo->dataSize =
+      atomic_load_explicit(&slot->dataSize, memory_order_relaxed);
+  keyInfo->dataType =
+      atomic_load_explicit(&slot->dataType, memory_order_relaxed);
+  keyInfo->dataAttributes =
+      atomic_load_explicit(&slot->dataAttributes, memory_order_relaxed);
+  return atomic_load_explicit(&slot->absent, memory_order_relaxed);
+}
+
+// Stores a slot's info, or marks the key absent if keyInfo is NULL.
+static void slot_store(KeyInfoSlot *slot, const UInt32 key,
+                       const SMCKeyData_keyInfo_t *keyInfo) {
+  const SMCKeyData_keyInfo_t none = {0, 0, 0};
+  const SMCKeyData_keyInfo_t *info = keyInfo != NULL ? keyInfo : &none;
+
+  // Order the info stores after any earlier clear of this slot, so a reader
+  // that copies the new info also sees the key change when re-checking.
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&slot->dataSize, info->dataSize, memory_order_relaxed);
+  atomic_store_explicit(&slot->dataType, info->dataType, memory_order_relaxed);
+  atomic_store_explicit(&slot->dataAttributes, info->dataAttributes,
+                        memory_order_relaxed);
+  atomic_store_explicit(&slot->absent, keyInfo == NULL, memory_order_relaxed);
+  atomic_store_explicit(&slot->referenced, 0, memory_order_relaxed);
+  atomic_store_explicit(&slot->key, key, memory_order_release);
+}
+
+SMCCacheLookup_t SMCKeyInfoCacheLookup(SMCKeyInfoCache_t *cache,
+                                       const UInt32 key,
+                                       SMCKeyData_keyInfo_t *keyInfo) {
+  if (key == 0) {
+    return CACHE_MISS;
+  }
+
+  const FrozenKeyInfo *frozen =
+      atomic_load_explicit(&cache->frozen, memory_order_acquire);
+  if (frozen != NULL && frozen_lookup(frozen, key, keyInfo)) {
+    return CACHE_HIT;
+  }
+
+  KeyInfoTable *table =
+      atomic_load_explicit(&cache->table, memory_order_acquire);
+  if (table == NULL) {
+    return CACHE_MISS;
+  }
+
+  for (UInt32 i = kh_hash_uint32(key) & table->mask;;
+       i = (i + 1) & table->mask) {
+    KeyInfoSlot *slot = &table->slots[i];
+
+    const UInt32 slotKey =
+        atomic_load_explicit(&slot->key, memory_order_acquire);
+    if (slotKey == 0) {
+      return CACHE_MISS;
+    }
+    if (slotKey != key) {
+      continue;
+    }
+
+    SMCKeyData_keyInfo_t info;
+    const UInt8 absent = slot_load(slot, &info);
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->key, memory_order_relaxed) != key) {
+      return CACHE_MISS;
+    }
+
+    // Only write when the bit is clear, so hot keys don't keep bouncing the
+    // slot's cache line between cores.
+    if (!atomic_load_explicit(&slot->referenced, memory_order_relaxed)) {
+      atomic_store_explicit(&slot->referenced, 1, memory_order_relaxed);
+    }
+    if (absent) {
+      return CACHE_ABSENT;
+    }
+
+    *keyInfo = info;
+    return CACHE_HIT;
+  }
+}
+
+// Stores a key in the first free slot of its probe run. This is safe on a
+// table readers can see because slot_store writes the key last.
+static void table_insert(KeyInfoTable *table, const UInt32 key,
+                                     const SMCKeyData_keyInfo_t *keyInfo) {
+  UInt32 i = kh_hash_uint32(key) & table->mask;
+  while (atomic_load_explicit(&table->slots[i].key, memory_order_relaxed) !=
+         0) {
+    i = (i + 1) & table->mask;
+  }
+
+  slot_store(&table->slots[i], key, keyInfo);
+  table->count++;
+}
+
+// The smallest power-of-two table that holds capacity keys at a load factor
+// of 3/4, capped at the default initial size.
+static UInt32 initial_table_size(const UInt32 capacity) {
+  if (capacity == 0) {
+    return KEY_INFO_CACHE_INITIAL_CAPACITY;
+  }
+
+  UInt32 size = 16;
+  while (size < KEY_INFO_CACHE_INITIAL_CAPACITY && size / 4 * 3 < capacity) {
+    size *= 2;
+  }
+  return size;
+}
+
+// Publishes a table with twice the capacity of the current one. The caller
+// must hold the cache's lock.
+static KeyInfoTable *cache_grow_locked(SMCKeyInfoCache_t *cache,
+                                       KeyInfoTable *old) {
+  const UInt32 size =
+      old == NULL ? initial_table_size(cache->capacity) : (old->mask + 1) * 2;
+
+  KeyInfoTable *table =
+      calloc(1, sizeof(KeyInfoTable) + size * sizeof(KeyInfoSlot));
+  if (table == NULL) {
+    return NULL;
+  }
+
+  table->mask = size - 1;
+  table->retired = old;
+
+  if (old != NULL) {
+    for (UInt32 i = 0; i <= old->mask; i++) {
+      SMCKeyData_keyInfo_t keyInfo;
+      const UInt32 key =
+          atomic_load_explicit(&old->slots[i].key, memory_order_relaxed);
+      if (key == 0) {
+        continue;
+      }
+
+      const UInt8 absent = slot_load(&old->slots[i], &keyInfo);
+      table_insert(table, key, absent ? NULL : &keyInfo);
+    }
+  }
+
+  cache->hand = 0;
+  atomic_store_explicit(&cache->table, table, memory_order_release);
+  return table;
+}
+
+// Empties slot i, shifting later entries of the same probe run back so no
+// lookup has to step over a hole. The caller must hold the cache's lock.
+static void table_remove_locked(KeyInfoTable *table, UInt32 i) {
+  atomic_store_explicit(&table->slots[i].key, 0, memory_order_relaxed);
+
+  for (UInt32 j = (i + 1) & table->mask;; j = (j + 1) & table->mask) {
+    KeyInfoSlot *slot = &table->slots[j];
+    const UInt32 key = atomic_load_explicit(&slot->key, memory_order_relaxed);
+    if (key == 0) {
+      break;
+    }
+
+    // The entry at j can fill the hole only if its home slot doesn't lie
+    // between the hole and j.
+    const UInt32 home = kh_hash_uint32(key) & table->mask;
+    if (((j - home) & table->mask) < ((j - i) & table->mask)) {
+      continue;
+    }
+
+    SMCKeyData_keyInfo_t keyInfo;
+    const UInt8 absent = slot_load(slot, &keyInfo);
+    const UInt8 referenced =
+        atomic_load_explicit(&slot->referenced, memory_order_relaxed);
+
+    slot_store(&table->slots[i], key, absent ? NULL : &keyInfo);
+    atomic_store_explicit(&table->slots[i].referenced, referenced,
+                          memory_order_relaxed);
+    atomic_store_explicit(&slot->key, 0, memory_order_relaxed);
+    i = j;
+  }
+
+  table->count--;
+}
+
+// Evicts one key using the clock algorithm. Two sweeps always find a victim:
+// the first clears every reference bit it passes. The caller must hold the
+// cache's lock.
+static void cache_evict_locked(SMCKeyInfoCache_t *cache, KeyInfoTable *table) {
+  for (UInt32 n = 0; n < 2 * (table->mask + 1); n++) {
+    const UInt32 i = cache->hand & table->mask;
+    cache->hand = (i + 1) & table->mask;
+
+    KeyInfoSlot *slot = &table->slots[i];
+    if (atomic_load_explicit(&slot->key, memory_order_relaxed) == 0) {
+      continue;
+    }
+    if (atomic_load_explicit(&slot->referenced, memory_order_relaxed)) {
+      atomic_store_explicit(&slot->referenced, 0, memory_order_relaxed);
+      continue;
+    }
+
+    table_remove_locked(table, i);
+    SMCStatsCount(SMC_STAT_CACHE_EVICTION);
+    return;
+  }
+}
+
+// Inserts a key, or records it as absent if keyInfo is NULL. The caller must
+// hold the cache's lock.
+static void cache_insert_locked(SMCKeyInfoCache_t *cache, const UInt32 key,
+                                const SMCKeyData_keyInfo_t *keyInfo) {
+  KeyInfoTable *table =
+      atomic_load_explicit(&cache->table, memory_order_relaxed);
+  if (key == 0) {
+    return;
+  }
+
+  if (table != NULL) {
+    for (UInt32 i = kh_hash_uint32(key) & table->mask;;
+         i = (i + 1) & table->mask) {
+      const UInt32 slotKey =
+          atomic_load_explicit(&table->slots[i].key, memory_order_relaxed);
+      if (slotKey == key) {
+        return;
+      }
+      if (slotKey == 0) {
+        break;
+      }
+    }
+
+    if (cache->capacity != 0 && table->count >= cache->capacity) {
+      cache_evict_locked(cache, table);
+    }
+  }
+
+  // Keep the load factor at or below 3/4 so probes stay short and always
+  // reach an empty slot.
+  if (table == NULL || (table->count + 1) * 4 > (table->mask + 1) * 3) {
+    table = cache_grow_locked(cache, table);
+    if (table == NULL) {
+      return;
+    }
+  }
+
+  table_insert(table, key, keyInfo);
+  SMCStatsCount(SMC_STAT_CACHE_INSERT);
+}
+
+void SMCKeyInfoCacheInsert(SMCKeyInfoCache_t *cache, const UInt32 key,
+                           const SMCKeyData_keyInfo_t *keyInfo) {
+  pthread_mutex_lock(&cache->lock);
+  cache_insert_locked(cache, key, keyInfo);
+  pthread_mutex_unlock(&cache->lock);
+}
+
+void SMCKeyInfoCacheInsertEntries(SMCKeyInfoCache_t *cache,
+                                  const SMCKeyInfoEntry_t *entries,
+                                  const size_t n) {
+  pthread_mutex_lock(&cache->lock);
+  for (size_t i = 0; i < n; i++) {
+    cache_insert_locked(cache, entries[i].key, &entries[i].keyInfo);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+int SMCKeyInfoCacheFreeze(SMCKeyInfoCache_t *cache,
+                          const SMCKeyInfoEntry_t *entries, const size_t n) {
+  UInt32 bucketCount = 1;
+  while (bucketCount < FROZEN_MAX_BUCKETS &&
+         (size_t)bucketCount * FROZEN_TARGET_LOAD < n) {
+    bucketCount *= 2;
+  }
+
+  FrozenKeyInfo *frozen = NULL;
+  for (;; bucketCount *= 2) {
+    int overflow;
+    frozen = frozen_create(entries, n, bucketCount, &overflow);
+    if (frozen != NULL) {
+      break;
+    }
+    if (!overflow || bucketCount == FROZEN_MAX_BUCKETS) {
+      return 0;
+    }
+  }
+
+  pthread_mutex_lock(&cache->lock);
+
+  FrozenKeyInfo *old =
+      atomic_load_explicit(&cache->frozen, memory_order_relaxed);
+  frozen->retired = old != NULL ? old : cache->retiredFrozen;
+  cache->retiredFrozen = NULL;
+  atomic_store_explicit(&cache->frozen, frozen, memory_order_release);
+
+  pthread_mutex_unlock(&cache->lock);
+  return 1;
+}
+
+void SMCKeyInfoCacheClear(SMCKeyInfoCache_t *cache) {
+  pthread_mutex_lock(&cache->lock);
+
+  FrozenKeyInfo *frozen =
+      atomic_load_explicit(&cache->frozen, memory_order_relaxed);
+  if (frozen != NULL) {
+    atomic_store_explicit(&cache->frozen, NULL, memory_order_release);
+    cache->retiredFrozen = frozen;
+  }
+
+  // The index was built under the cached firmware version, so both go: the
+  // next enumeration reads the version and #KEY again.
+  KeyIndex *index = atomic_load_explicit(&cache->index, memory_order_relaxed);
+  if (index != NULL) {
+    atomic_store_explicit(&cache->index, NULL, memory_order_release);
+    cache->retiredIndex = index;
+  }
+  atomic_store_explicit(&cache->version, 0, memory_order_relaxed);
+
+  // Empty the live table in place rather than freeing it, since lock-free
+  // readers may be probing it right now.
+  KeyInfoTable *table =
+      atomic_load_explicit(&cache->table, memory_order_relaxed);
+  if (table != NULL) {
+    for (UInt32 i = 0; i <= table->mask; i++) {
+      atomic_store_explicit(&table->slots[i].key, 0, memory_order_relaxed);
+    }
+    table->count = 0;
+  }
+  cache->hand = 0;
+
+  pthread_mutex_unlock(&cache->lock);
+}
+
+size_t SMCKeyInfoCacheCount(SMCKeyInfoCache_t *cache) {
+  pthread_mutex_lock(&cache->lock);
+  const KeyInfoTable *table =
+      atomic_load_explicit(&cache->table, memory_order_relaxed);
+  const size_t count = table != NULL ? table->count : 0;
+  pthread_mutex_unlock(&cache->lock);
+  return count;
+}
+
+int SMCKeyInfoCacheIndexCount(SMCKeyInfoCache_t *cache, UInt32 *count) {
+  const KeyIndex *index =
+      atomic_load_explicit(&cache->index, memory_order_acquire);
+  if (index == NULL) {
+    return 0;
+  }
+
+  *count = index->count;
+  return 1;
+}
+
+// Publishes an index for count keys unless the cache already has one.
+static KeyIndex *index_create(SMCKeyInfoCache_t *cache, const UInt32 count) {
+  pthread_mutex_lock(&cache->lock);
+
+  KeyIndex *index = atomic_load_explicit(&cache->index, memory_order_relaxed);
+  if (index == NULL) {
+    index = calloc(1, sizeof(KeyIndex) + count * sizeof(UInt32));
+    if (index != NULL) {
+      index->count = count;
+      index->retired = cache->retiredIndex;
+      cache->retiredIndex = NULL;
+      atomic_store_explicit(&cache->index, index, memory_order_release);
+    }
+  }
+
+  pthread_mutex_unlock(&cache->lock);
+  return index;
+}
+
+void SMCKeyInfoCacheIndexCreate(SMCKeyInfoCache_t *cache, const UInt32 count) {
+  index_create(cache, count);
+}
+
+UInt32 SMCKeyInfoCacheIndexLookup(SMCKeyInfoCache_t *cache,
+                                  const UInt32 position) {
+  const KeyIndex *index =
+      atomic_load_explicit(&cache->index, memory_order_acquire);
+  if (index == NULL || position >= index->count) {
+    return 0;
+  }
+  return atomic_load_explicit(&index->keys[position], memory_order_relaxed);
+}
+
+void SMCKeyInfoCacheIndexStore(SMCKeyInfoCache_t *cache, const UInt32 position,
+                               const UInt32 key) {
+  KeyIndex *index = atomic_load_explicit(&cache->index, memory_order_acquire);
+  if (index != NULL && position < index->count) {
+    atomic_store_explicit(&index->keys[position], key, memory_order_relaxed);
+  }
+}
+
+void SMCKeyInfoCacheIndexCopy(SMCKeyInfoCache_t *cache, UInt32 *keys,
+                              const UInt32 count) {
+  const KeyIndex *index =
+      atomic_load_explicit(&cache->index, memory_order_acquire);
+
+  for (UInt32 i = 0; i < count; i++) {
+    keys[i] = index != NULL && i < index->count
+                  ? atomic_load_explicit(&index->keys[i], memory_order_relaxed)
+                  : 0;
+  }
+}
+
+void SMCKeyInfoCacheIndexInstall(SMCKeyInfoCache_t *cache, const UInt32 *keys,
+                                 const UInt32 count) {
+  KeyIndex *index = index_create(cache, count);
+  if (index == NULL) {
+    return;
+  }
+
+  for (UInt32 i = 0; i < count && i < index->count; i++) {
+    if (keys[i] != 0) {
+      atomic_store_explicit(&index->keys[i], keys[i], memory_order_relaxed);
+    }
+  }
+}
+
+int SMCKeyInfoCacheVersion(SMCKeyInfoCache_t *cache, SMCKeyData_vers_t *vers) {
+  const UInt64 packed =
+      atomic_load_explicit(&cache->version, memory_order_relaxed);
+  if (!(packed & VERSION_CACHED)) {
+    return 0;
+  }
+
+  memcpy(vers, &packed, sizeof(SMCKeyData_vers_t));
+  return 1;
+}
+
+void SMCKeyInfoCacheSetVersion(SMCKeyInfoCache_t *cache,
+                               const SMCKeyData_vers_t *vers) {
+  // Racing callers read the same version, so whichever store lands is fine.
+  UInt64 packed = 0;
+  memcpy(&packed, vers, sizeof(SMCKeyData_vers_t));
+  atomic_store_explicit(&cache->version, packed | VERSION_CACHED,
+                        memory_order_relaxed);
+}
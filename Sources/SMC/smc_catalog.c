@@ -0,0 +1,241 @@
+/*
+ MIT License
+
+ Copyright (c) 2025 Sriman Achanta
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "smc.h"
+#include "smc_internal.h"
+
+// Two copies of the same entries: one sorted by key for lookups and prefix
+// scans, one sorted by type then key for type queries. Either way a query is a
+// pair of binary searches that returns a contiguous range.
+struct SMCCatalog {
+  UInt32 count;
+  SMCCatalogEntry_t *byKey;
+  SMCCatalogEntry_t *byType;
+};
+
+static int compare_key(const void *a, const void *b) {
+  const UInt32 x = ((const SMCCatalogEntry_t *)a)->key;
+  const UInt32 y = ((const SMCCatalogEntry_t *)b)->key;
+  return (x > y) - (x < y);
+}
+
+static int compare_type(const void *a, const void *b) {
+  const SMCCatalogEntry_t *x = a;
+  const SMCCatalogEntry_t *y = b;
+  if (x->dataType != y->dataType) {
+    return (x->dataType > y->dataType) - (x->dataType < y->dataType);
+  }
+  return (x->key > y->key) - (x->key < y->key);
+}
+
+// The first entry whose key is >= key.
+static UInt32 lower_bound_key(const SMCCatalogEntry_t *entries, UInt32 count,
+                              const UInt64 key) {
+  UInt32 lo = 0;
+  UInt32 hi = count;
+
+  while (lo < hi) {
+    const UInt32 mid = lo + (hi - lo) / 2;
+    if (entries[mid].key < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+// The first entry whose type is >= dataType.
+static UInt32 lower_bound_type(const SMCCatalogEntry_t *entries, UInt32 count,
+                               const UInt64 dataType) {
+  UInt32 lo = 0;
+  UInt32 hi = count;
+
+  while (lo < hi) {
+    const UInt32 mid = lo + (hi - lo) / 2;
+    if (entries[mid].dataType < dataType) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static SMCCatalog_t *catalog_create(const SMCKeyInfoEntry_t *entries,
+                                    const size_t n) {
+  SMCCatalog_t *catalog = calloc(1, sizeof(SMCCatalog_t));
+  if (catalog == NULL) {
+    return NULL;
+  }
+
+  const size_t bytes = (n > 0 ? n : 1) * sizeof(SMCCatalogEntry_t);
+  catalog->byKey = malloc(bytes);
+  catalog->byType = malloc(bytes);
+  if (catalog->byKey == NULL || catalog->byType == NULL) {
+    SMCCatalogDestroy(catalog);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    SMCCatalogEntry_t *entry = &catalog->byKey[i];
+    memset(entry, 0, sizeof(SMCCatalogEntry_t));
+    entry->key = entries[i].key;
+    entry->dataType = entries[i].keyInfo.dataType;
+    entry->dataSize = entries[i].keyInfo.dataSize;
+    entry->dataAttributes = entries[i].keyInfo.dataAttributes;
+  }
+  catalog->count = (UInt32)n;
+
+  qsort(catalog->byKey, n, sizeof(SMCCatalogEntry_t), compare_key);
+  memcpy(catalog->byType, catalog->byKey, n * sizeof(SMCCatalogEntry_t));
+  qsort(catalog->byType, n, sizeof(SMCCatalogEntry_t), compare_type);
+
+  return catalog;
+}
+
+SMCResult_t SMCCachedCatalogCreate(SMCKeyInfoCache_t *cache,
+                                   const SMCTransport_t *transport,
+                                   const io_connect_t conn,
+                                   SMCCatalog_t **catalog) {
+  SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
+  UInt32 keyCount;
+
+  if (catalog == NULL) {
+    return result;
+  }
+  *catalog = NULL;
+
+  result = SMCCachedGetKeyCount(cache, transport, &keyCount, conn);
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    return result;
+  }
+
+  SMCKeyInfoEntry_t *entries =
+      malloc((keyCount > 0 ? keyCount : 1) * sizeof(SMCKeyInfoEntry_t));
+  if (entries == NULL) {
+    result.kern_res = kIOReturnNoMemory;
+    result.smc_res = kSMCReturnError;
+    return result;
+  }
+
+  size_t n;
+  result = SMCReadAllKeyInfo(cache, transport, keyCount, entries, &n, conn);
+  if (result.kern_res == kIOReturnSuccess &&
+      result.smc_res == kSMCReturnSuccess) {
+    *catalog = catalog_create(entries, n);
+    if (*catalog == NULL) {
+      result.kern_res = kIOReturnNoMemory;
+      result.smc_res = kSMCReturnError;
+    }
+  }
+
+  free(entries);
+  return result;
+}
+
+SMCResult_t SMCCatalogCreate(const io_connect_t conn, SMCCatalog_t **catalog) {
+  return SMCCachedCatalogCreate(SMCSharedKeyInfoCache(), NULL, conn, catalog);
+}
+
+void SMCCatalogDestroy(SMCCatalog_t *catalog) {
+  if (catalog == NULL) {
+    return;
+  }
+  free(catalog->byKey);
+  free(catalog->byType);
+  free(catalog);
+}
+
+UInt32 SMCCatalogCount(const SMCCatalog_t *catalog) {
+  return catalog != NULL ? catalog->count : 0;
+}
+
+const SMCCatalogEntry_t *SMCCatalogEntries(const SMCCatalog_t *catalog) {
+  return catalog != NULL ? catalog->byKey : NULL;
+}
+
+const SMCCatalogEntry_t *SMCCatalogEntriesByType(const SMCCatalog_t *catalog) {
+  return catalog != NULL ? catalog->byType : NULL;
+}
+
+const SMCCatalogEntry_t *SMCCatalogFind(const SMCCatalog_t *catalog,
+                                        const UInt32 key) {
+  if (catalog == NULL) {
+    return NULL;
+  }
+
+  const UInt32 i = lower_bound_key(catalog->byKey, catalog->count, key);
+  if (i < catalog->count && catalog->byKey[i].key == key) {
+    return &catalog->byKey[i];
+  }
+  return NULL;
+}
+
+UInt32 SMCCatalogPrefixRange(const SMCCatalog_t *catalog, const char *prefix,
+                             UInt32 *first) {
+  *first = 0;
+  if (catalog == NULL || prefix == NULL) {
+    return 0;
+  }
+
+  const size_t length = strnlen(prefix, 5);
+  if (length > 4) {
+    return 0;
+  }
+
+  // Keys are packed big-endian, so every key starting with prefix lies in
+  // [prefix followed by 0x00 bytes, prefix + 1 followed by 0x00 bytes).
+  UInt64 lo = 0;
+  for (size_t i = 0; i < length; i++) {
+    lo = lo << 8 | (UInt8)prefix[i];
+  }
+  const unsigned shift = 8 * (unsigned)(4 - length);
+  lo <<= shift;
+  const UInt64 hi = lo + ((UInt64)1 << shift);
+
+  const UInt32 start = lower_bound_key(catalog->byKey, catalog->count, lo);
+  const UInt32 end = lower_bound_key(catalog->byKey, catalog->count, hi);
+  *first = start;
+  return end - start;
+}
+
+UInt32 SMCCatalogTypeRange(const SMCCatalog_t *catalog, const UInt32 dataType,
+                           UInt32 *first) {
+  *first = 0;
+  if (catalog == NULL) {
+    return 0;
+  }
+
+  const UInt32 start =
+      lower_bound_type(catalog->byType, catalog->count, dataType);
+  const UInt32 end =
+      lower_bound_type(catalog->byType, catalog->count, (UInt64)dataType + 1);
+  *first = start;
+  return end - start;
+}
@@ -0,0 +1,257 @@
+/*
+ MIT License
+
+ Copyright (c) 2025 Sriman Achanta
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include <stdlib.h>
+
+#include "smc.h"
+#include "smc_internal.h"
+
+struct SMCContext {
+  io_connect_t conn;
+  SMCKeyInfoCache_t *cache;
+  // Every call on conn goes through here, including IOKit's.
+  const SMCTransport_t *transport;
+};
+
+kern_return_t SMCContextCreate(const UInt32 cacheCapacity,
+                               SMCContext_t **context) {
+  return SMCContextCreateWithTransport(cacheCapacity, SMCIOKitTransport(),
+                                       context);
+}
+
+kern_return_t SMCContextCreateWithTransport(const UInt32 cacheCapacity,
+                                            const SMCTransport_t *transport,
+                                            SMCContext_t **context) {
+  if (context == NULL || transport == NULL) {
+    return kIOReturnBadArgument;
+  }
+  *context = NULL;
+
+  SMCContext_t *created = calloc(1, sizeof(SMCContext_t));
+  if (created == NULL) {
+    return kIOReturnNoMemory;
+  }
+
+  created->cache = SMCKeyInfoCacheCreate(cacheCapacity);
+  if (created->cache == NULL) {
+    free(created);
+    return kIOReturnNoMemory;
+  }
+
+  created->transport = transport;
+  const kern_return_t result =
+      transport->open(transport->context, &created->conn);
+  if (result != kIOReturnSuccess) {
+    SMCKeyInfoCacheDestroy(created->cache);
+    free(created);
+    return result;
+  }
+
+  *context = created;
+  return kIOReturnSuccess;
+}
+
+void SMCContextDestroy(SMCContext_t *context) {
+  if (context == NULL) {
+    return;
+  }
+
+  context->transport->close(context->transport->context, context->conn);
+  SMCKeyInfoCacheDestroy(context->cache);
+  free(context);
+}
+
+io_connect_t SMCContextConnection(const SMCContext_t *context) {
+  return context != NULL ? context->conn : 0;
+}
+
+void SMCContextResetCache(SMCContext_t *context) {
+  if (context != NULL) {
+    SMCKeyInfoCacheClear(context->cache);
+  }
+}
+
+size_t SMCContextCacheCount(const SMCContext_t *context) {
+  return context != NULL ? SMCKeyInfoCacheCount(context->cache) : 0;
+}
+
+SMCResult_t SMCContextGetKeyInfo(SMCContext_t *context, const UInt32 key,
+                                 SMCKeyData_keyInfo_t *keyInfo) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCCachedGetKeyInfo(context->cache, context->transport, key, keyInfo,
+                             context->conn);
+}
+
+SMCResult_t SMCContextIsKeyFound(SMCContext_t *context, const UInt32 key,
+                                 bool *found) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCCachedIsKeyFound(context->cache, context->transport, key, found,
+                             context->conn);
+}
+
+SMCResult_t SMCContextResolveKey(SMCContext_t *context, const UInt32Char_t *key,
+                                 SMCKeyHandle_t *handle) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCCachedResolveKey(context->cache, context->transport, key, handle,
+                             context->conn);
+}
+
+SMCResult_t SMCContextReadKey(SMCContext_t *context, const UInt32Char_t *key,
+                              SMCVal_t *val) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCCachedReadKey(context->cache, context->transport, key, val,
+                          context->conn);
+}
+
+SMCResult_t SMCContextReadKeyResolved(SMCContext_t *context,
+                                      const SMCKeyHandle_t *handle,
+                                      SMCVal_t *val) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCTransportReadKeyResolved(context->transport, handle, val,
+                                     context->conn);
+}
+
+kern_return_t SMCContextReadKeys(SMCContext_t *context,
+                                 const UInt32Char_t *keys, SMCVal_t *vals,
+                                 SMCResult_t *results, const size_t n) {
+  if (context == NULL) {
+    return kIOReturnBadArgument;
+  }
+  return SMCCachedReadKeys(context->cache, context->transport, keys, vals,
+                           results, n, context->conn);
+}
+
+SMCResult_t SMCContextWriteKey(SMCContext_t *context, const SMCVal_t *val) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCCachedWriteKey(context->cache, context->transport, val,
+                           context->conn);
+}
+
+SMCResult_t SMCContextWriteKeyResolved(SMCContext_t *context,
+                                       const SMCKeyHandle_t *handle,
+                                       const SMCVal_t *val) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCTransportWriteKeyResolved(context->transport, handle, val,
+                                      context->conn);
+}
+
+kern_return_t SMCContextWriteKeys(SMCContext_t *context, const SMCVal_t *vals,
+                                  SMCResult_t *results, const size_t n) {
+  if (context == NULL) {
+    return kIOReturnBadArgument;
+  }
+  return SMCCachedWriteKeys(context->cache, context->transport, vals, results,
+                            n, context->conn);
+}
+
+SMCResult_t SMCContextGetKeyCount(SMCContext_t *context, UInt32 *count) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCCachedGetKeyCount(context->cache, context->transport, count,
+                              context->conn);
+}
+
+SMCResult_t SMCContextGetKeyFromIndex(SMCContext_t *context,
+                                      const UInt32 index, UInt32Char_t *key) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCCachedGetKeyFromIndex(context->cache, context->transport, index,
+                                  key, context->conn);
+}
+
+SMCResult_t SMCContextPrefetchKeyInfo(SMCContext_t *context) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCCachedPrefetchKeyInfo(context->cache, context->transport,
+                                  context->conn);
+}
+
+SMCResult_t SMCContextFreezeKeyInfo(SMCContext_t *context) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCCachedFreezeKeyInfo(context->cache, context->transport,
+                                context->conn);
+}
+
+SMCResult_t SMCContextLoadKeyInfoCache(SMCContext_t *context,
+                                       const char *path) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCCachedLoadKeyInfoCache(context->cache, context->transport, path,
+                                   context->conn);
+}
+
+SMCResult_t SMCContextCreateCatalog(SMCContext_t *context,
+                                    SMCCatalog_t **catalog) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCCachedCatalogCreate(context->cache, context->transport,
+                                context->conn, catalog);
+}
+
+SMCResult_t SMCContextReadVersion(SMCContext_t *context,
+                                  SMCKeyData_vers_t *vers) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCCachedReadVersion(context->cache, context->transport, vers,
+                              context->conn);
+}
+
+SMCResult_t SMCContextWriteSnapshot(SMCContext_t *context, const char *path) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCCachedWriteSnapshot(context->cache, context->transport, path,
+                                context->conn);
+}
+
+SMCResult_t SMCContextReadPowerLimits(SMCContext_t *context,
+                                      SMCKeyData_pLimitData_t *limits) {
+  if (context == NULL) {
+    return (SMCResult_t){kIOReturnBadArgument, kSMCReturnError};
+  }
+  return SMCTransportReadPowerLimits(context->transport, limits,
+                                     context->conn);
+}
@@ -0,0 +1,255 @@
+/*
+ MIT License
+
+ Copyright (c) 2025 Sriman Achanta
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#ifndef SMC_INTERNAL_H
+#define SMC_INTERNAL_H
+
+#include <stdatomic.h>
+
+#include "smc.h"
+
+// Shared between the translation units of the C library only.
+
+typedef struct {
+  UInt32 key;
+  SMCKeyData_keyInfo_t keyInfo;
+} SMCKeyInfoEntry_t;
+
+UInt32 FourCharCodeFromString(const UInt32Char_t *str);
+void StringFromFourCharCode(UInt32 code, UInt32Char_t *out);
+
+// A key info cache, see smc_cache.c. The connection-based API shares one
+// process-wide instance; each SMCContext owns another.
+typedef struct SMCKeyInfoCache SMCKeyInfoCache_t;
+
+typedef enum { CACHE_MISS, CACHE_HIT, CACHE_ABSENT } SMCCacheLookup_t;
+
+SMCKeyInfoCache_t *SMCSharedKeyInfoCache(void);
+
+// capacity bounds the number of keys held, or 0 for no bound.
+SMCKeyInfoCache_t *SMCKeyInfoCacheCreate(UInt32 capacity);
+// The cache must not be in use by any other thread.
+void SMCKeyInfoCacheDestroy(SMCKeyInfoCache_t *cache);
+// Safe to call while other threads use the cache.
+void SMCKeyInfoCacheClear(SMCKeyInfoCache_t *cache);
+size_t SMCKeyInfoCacheCount(SMCKeyInfoCache_t *cache);
+
+// Looks up a key without taking any lock.
+SMCCacheLookup_t SMCKeyInfoCacheLookup(SMCKeyInfoCache_t *cache, UInt32 key,
+                                       SMCKeyData_keyInfo_t *keyInfo);
+// Caches a key's info, or records it as absent if keyInfo is NULL.
+void SMCKeyInfoCacheInsert(SMCKeyInfoCache_t *cache, UInt32 key,
+                           const SMCKeyData_keyInfo_t *keyInfo);
+// Inserts n entries under a single lock acquisition.
+void SMCKeyInfoCacheInsertEntries(SMCKeyInfoCache_t *cache,
+                                  const SMCKeyInfoEntry_t *entries, size_t n);
+// Publishes a read-only table of the n entries that serves lookups ahead of
+// the dynamic table, replacing any earlier one. Meant for the complete key
+// set; keys it doesn't hold are still looked up and cached as usual. Clearing
+// the cache drops it. Returns 0 if memory runs out.
+int SMCKeyInfoCacheFreeze(SMCKeyInfoCache_t *cache,
+                          const SMCKeyInfoEntry_t *entries, size_t n);
+
+// The cache's index-to-key table, which holds the key count and the key at
+// each index once they have been read. Clearing the cache drops it along with
+// the cached firmware version.
+//
+// Sets count and returns 1 if the cache has an index.
+int SMCKeyInfoCacheIndexCount(SMCKeyInfoCache_t *cache, UInt32 *count);
+// Publishes an empty index for count keys unless the cache already has one.
+void SMCKeyInfoCacheIndexCreate(SMCKeyInfoCache_t *cache, UInt32 count);
+// The key at position, or 0 if it hasn't been fetched.
+UInt32 SMCKeyInfoCacheIndexLookup(SMCKeyInfoCache_t *cache, UInt32 position);
+// Records the key at position. Does nothing without an index to hold it.
+void SMCKeyInfoCacheIndexStore(SMCKeyInfoCache_t *cache, UInt32 position,
+                               UInt32 key);
+// Copies the index into keys, with 0 for positions that haven't been fetched.
+void SMCKeyInfoCacheIndexCopy(SMCKeyInfoCache_t *cache, UInt32 *keys,
+                              UInt32 count);
+// Seeds the index, e.g. from a persistent cache file.
+void SMCKeyInfoCacheIndexInstall(SMCKeyInfoCache_t *cache, const UInt32 *keys,
+                                 UInt32 count);
+
+// The firmware version read through the cache. Returns 0 if none has been
+// since the cache was created or last cleared.
+int SMCKeyInfoCacheVersion(SMCKeyInfoCache_t *cache, SMCKeyData_vers_t *vers);
+void SMCKeyInfoCacheSetVersion(SMCKeyInfoCache_t *cache,
+                               const SMCKeyData_vers_t *vers);
+
+// Writes the buffers in parts to a temporary file next to path and renames it
+// into place, so readers never see a partial file. Returns 1 on success.
+int SMCWriteFileAtomically(const char *path, const void *const *parts,
+                           const size_t *sizes, size_t count);
+
+// Issues a call through transport, or straight to IOKit if transport is NULL,
+// without instrumentation.
+static inline kern_return_t
+SMCTransportDispatch(const SMCTransport_t *transport, const int selector,
+                     const SMCKeyData_t *inputStructure,
+                     SMCKeyData_t *outputStructure, const io_connect_t conn) {
+  if (transport != NULL) {
+    return transport->call(transport->context, conn, selector, inputStructure,
+                           outputStructure);
+  }
+
+  size_t structureOutputSize = sizeof(SMCKeyData_t);
+  return IOConnectCallStructMethod(conn, selector, inputStructure,
+                                   sizeof(SMCKeyData_t), outputStructure,
+                                   &structureOutputSize);
+}
+
+// SMCCall through transport. Every function below that takes a transport
+// sends its commands this way, so a context's calls reach its transport
+// without any lookup; the connection-based API passes NULL.
+kern_return_t SMCTransportCall(const SMCTransport_t *transport, int selector,
+                               const SMCKeyData_t *inputStructure,
+                               SMCKeyData_t *outputStructure,
+                               io_connect_t conn);
+
+// The public key operations against a given cache and transport. SMCReadKey
+// and friends call these with the shared cache and no transport.
+SMCResult_t SMCCachedGetKeyInfo(SMCKeyInfoCache_t *cache,
+                                const SMCTransport_t *transport, UInt32 key,
+                                SMCKeyData_keyInfo_t *keyInfo,
+                                io_connect_t conn);
+SMCResult_t SMCCachedIsKeyFound(SMCKeyInfoCache_t *cache,
+                                const SMCTransport_t *transport, UInt32 key,
+                                bool *found, io_connect_t conn);
+SMCResult_t SMCCachedResolveKey(SMCKeyInfoCache_t *cache,
+                                const SMCTransport_t *transport,
+                                const UInt32Char_t *key,
+                                SMCKeyHandle_t *handle, io_connect_t conn);
+SMCResult_t SMCCachedReadKey(SMCKeyInfoCache_t *cache,
+                             const SMCTransport_t *transport,
+                             const UInt32Char_t *key, SMCVal_t *val,
+                             io_connect_t conn);
+kern_return_t SMCCachedReadKeys(SMCKeyInfoCache_t *cache,
+                                const SMCTransport_t *transport,
+                                const UInt32Char_t *keys, SMCVal_t *vals,
+                                SMCResult_t *results, size_t n,
+                                io_connect_t conn);
+SMCResult_t SMCCachedWriteKey(SMCKeyInfoCache_t *cache,
+                              const SMCTransport_t *transport,
+                              const SMCVal_t *val, io_connect_t conn);
+kern_return_t SMCCachedWriteKeys(SMCKeyInfoCache_t *cache,
+                                 const SMCTransport_t *transport,
+                                 const SMCVal_t *vals, SMCResult_t *results,
+                                 size_t n, io_connect_t conn);
+SMCResult_t SMCCachedGetKeyCount(SMCKeyInfoCache_t *cache,
+                                 const SMCTransport_t *transport,
+                                 UInt32 *count, io_connect_t conn);
+SMCResult_t SMCCachedGetKeyFromIndex(SMCKeyInfoCache_t *cache,
+                                     const SMCTransport_t *transport,
+                                     UInt32 index, UInt32Char_t *key,
+                                     io_connect_t conn);
+// SMCReadVersion that only goes to the SMC until a read succeeds.
+SMCResult_t SMCCachedReadVersion(SMCKeyInfoCache_t *cache,
+                                 const SMCTransport_t *transport,
+                                 SMCKeyData_vers_t *vers, io_connect_t conn);
+
+// The public operations that need no cache, through a given transport.
+SMCResult_t SMCTransportReadVersion(const SMCTransport_t *transport,
+                                    SMCKeyData_vers_t *vers,
+                                    io_connect_t conn);
+SMCResult_t SMCTransportReadPowerLimits(const SMCTransport_t *transport,
+                                        SMCKeyData_pLimitData_t *limits,
+                                        io_connect_t conn);
+SMCResult_t SMCTransportReadKeyResolved(const SMCTransport_t *transport,
+                                        const SMCKeyHandle_t *handle,
+                                        SMCVal_t *val, io_connect_t conn);
+SMCResult_t SMCTransportWriteKeyResolved(const SMCTransport_t *transport,
+                                         const SMCKeyHandle_t *handle,
+                                         const SMCVal_t *val,
+                                         io_connect_t conn);
+
+// Fetches the info of every key, spreading the work over several connections
+// when the calls go to IOKit. entries must hold keyCount entries; on return
+// the first n hold the keys whose info could be read, in index order. cache
+// is filled as a side effect.
+SMCResult_t SMCReadAllKeyInfo(SMCKeyInfoCache_t *cache,
+                              const SMCTransport_t *transport, UInt32 keyCount,
+                              SMCKeyInfoEntry_t *entries, size_t *n,
+                              io_connect_t conn);
+
+// Fills cache with every key's info, see SMCPrefetchKeyInfo.
+SMCResult_t SMCCachedPrefetchKeyInfo(SMCKeyInfoCache_t *cache,
+                                     const SMCTransport_t *transport,
+                                     io_connect_t conn);
+// Fills cache with every key's info and freezes it, see SMCFreezeKeyInfo.
+SMCResult_t SMCCachedFreezeKeyInfo(SMCKeyInfoCache_t *cache,
+                                   const SMCTransport_t *transport,
+                                   io_connect_t conn);
+
+// Fills cache from a cache file or the SMC, see SMCLoadKeyInfoCache.
+SMCResult_t SMCCachedLoadKeyInfoCache(SMCKeyInfoCache_t *cache,
+                                      const SMCTransport_t *transport,
+                                      const char *path, io_connect_t conn);
+
+// Writes a snapshot of every key, see SMCWriteSnapshot.
+SMCResult_t SMCCachedWriteSnapshot(SMCKeyInfoCache_t *cache,
+                                   const SMCTransport_t *transport,
+                                   const char *path, io_connect_t conn);
+
+// Builds a catalog from every key's info, see SMCCatalogCreate.
+SMCResult_t SMCCachedCatalogCreate(SMCKeyInfoCache_t *cache,
+                                   const SMCTransport_t *transport,
+                                   io_connect_t conn, SMCCatalog_t **catalog);
+
+// Instrumentation hooks, see smc_stats.c. The flags are checked inline so
+// disabled instrumentation costs a relaxed load and a branch.
+#define SMC_INSTRUMENT_STATS 0x1
+#define SMC_INSTRUMENT_SIGNPOSTS 0x2
+
+extern _Atomic int g_smcInstrumentation;
+
+typedef enum {
+  SMC_STAT_CACHE_HIT,
+  SMC_STAT_CACHE_ABSENT_HIT,
+  SMC_STAT_CACHE_MISS,
+  SMC_STAT_CACHE_INSERT,
+  SMC_STAT_CACHE_EVICTION,
+  SMC_STAT_COUNTER_COUNT
+} SMCStatCounter;
+
+void SMCStatsIncrement(SMCStatCounter counter);
+
+static inline int SMCInstrumentation(void) {
+  return atomic_load_explicit(&g_smcInstrumentation, memory_order_relaxed);
+}
+
+static inline void SMCStatsCount(const SMCStatCounter counter) {
+  if (SMCInstrumentation() & SMC_INSTRUMENT_STATS) {
+    SMCStatsIncrement(counter);
+  }
+}
+
+// SMCTransportCall with counting and signposts according to flags. Calls are
+// only timed when counting is on.
+kern_return_t SMCInstrumentedCall(int flags, const SMCTransport_t *transport,
+                                  int selector,
+                                  const SMCKeyData_t *inputStructure,
+                                  SMCKeyData_t *outputStructure,
+                                  io_connect_t conn);
+
+#endif
@@ -0,0 +1,234 @@
+/*
+ MIT License
+
+ Copyright (c) 2025 Sriman Achanta
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "smc.h"
+#include "smc_internal.h"
+
+#define KEY_INFO_FILE_MAGIC 0x534D4349 // 'SMCI'
+#define KEY_INFO_FILE_FORMAT 2
+
+// The file is a header followed by entryCount entries sorted by key, so it can
+// be mapped and used in place, and then the index-to-key table with keyCount
+// keys (0 for any index that couldn't be read). The firmware version and key
+// count identify the SMC the entries were read from.
+typedef struct {
+  UInt32 magic;
+  UInt32 format;
+  SMCKeyData_vers_t vers;
+  UInt32 keyCount;
+  UInt32 entryCount;
+} KeyInfoFileHeader;
+
+static int header_matches(const KeyInfoFileHeader *a,
+                          const KeyInfoFileHeader *b) {
+  return a->magic == b->magic && a->format == b->format &&
+         a->vers.major == b->vers.major && a->vers.minor == b->vers.minor &&
+         a->vers.build == b->vers.build &&
+         a->vers.release == b->vers.release && a->keyCount == b->keyCount;
+}
+
+static int compare_entries(const void *a, const void *b) {
+  const UInt32 lhs = ((const SMCKeyInfoEntry_t *)a)->key;
+  const UInt32 rhs = ((const SMCKeyInfoEntry_t *)b)->key;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+// Maps the file and inserts its entries and index-to-key table into cache if
+// it was written for the expected SMC. Returns 1 if the cache was filled.
+static int load_file(SMCKeyInfoCache_t *cache, const char *path,
+                     const KeyInfoFileHeader *expected) {
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(KeyInfoFileHeader)) {
+    close(fd);
+    return 0;
+  }
+
+  const size_t size = (size_t)st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return 0;
+  }
+
+  int loaded = 0;
+  const KeyInfoFileHeader *header = map;
+  if (header_matches(header, expected) &&
+      size == sizeof(KeyInfoFileHeader) +
+                  (size_t)header->entryCount * sizeof(SMCKeyInfoEntry_t) +
+                  (size_t)header->keyCount * sizeof(UInt32)) {
+    const SMCKeyInfoEntry_t *entries =
+        (const SMCKeyInfoEntry_t *)((const char *)map +
+                                    sizeof(KeyInfoFileHeader));
+    const UInt32 *indexKeys = (const UInt32 *)(entries + header->entryCount);
+
+    SMCKeyInfoCacheInsertEntries(cache, entries, header->entryCount);
+    SMCKeyInfoCacheIndexInstall(cache, indexKeys, header->keyCount);
+    loaded = 1;
+  }
+
+  munmap(map, size);
+  return loaded;
+}
+
+int SMCWriteFileAtomically(const char *path, const void *const *parts,
+                           const size_t *sizes, const size_t count) {
+  const size_t pathLength = strlen(path);
+  char *tmpPath = malloc(pathLength + sizeof(".XXXXXX"));
+  if (tmpPath == NULL) {
+    return 0;
+  }
+  memcpy(tmpPath, path, pathLength);
+  memcpy(tmpPath + pathLength, ".XXXXXX", sizeof(".XXXXXX"));
+
+  const int fd = mkstemp(tmpPath);
+  if (fd < 0) {
+    free(tmpPath);
+    return 0;
+  }
+
+  int ok = 1;
+  for (size_t i = 0; ok && i < count; i++) {
+    ok = write(fd, parts[i], sizes[i]) == (ssize_t)sizes[i];
+  }
+  ok = ok && fsync(fd) == 0;
+  ok = close(fd) == 0 && ok;
+  ok = ok && rename(tmpPath, path) == 0;
+
+  if (!ok) {
+    unlink(tmpPath);
+  }
+  free(tmpPath);
+  return ok;
+}
+
+static int write_file(const char *path, const KeyInfoFileHeader *header,
+                      const SMCKeyInfoEntry_t *entries, const size_t n,
+                      const UInt32 *indexKeys) {
+  const void *const parts[] = {header, entries, indexKeys};
+  const size_t sizes[] = {sizeof(*header), n * sizeof(SMCKeyInfoEntry_t),
+                          header->keyCount * sizeof(UInt32)};
+  return SMCWriteFileAtomically(path, parts, sizes, 3);
+}
+
+SMCResult_t SMCCachedLoadKeyInfoCache(SMCKeyInfoCache_t *cache,
+                                      const SMCTransport_t *transport,
+                                      const char *path,
+                                      const io_connect_t conn) {
+  SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
+
+  if (path == NULL) {
+    return result;
+  }
+
+  KeyInfoFileHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = KEY_INFO_FILE_MAGIC;
+  header.format = KEY_INFO_FILE_FORMAT;
+
+  // Firmware that doesn't report a version gets an unversioned file, matched
+  // on the key count alone.
+  result = SMCCachedReadVersion(cache, transport, &header.vers, conn);
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    memset(&header.vers, 0, sizeof(header.vers));
+  }
+
+  // Read through transport into cache, so the file is matched against the SMC
+  // this cache serves.
+  result = SMCCachedGetKeyCount(cache, transport, &header.keyCount, conn);
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    return result;
+  }
+
+  if (load_file(cache, path, &header)) {
+    return result;
+  }
+
+  SMCKeyInfoEntry_t *entries =
+      calloc(header.keyCount > 0 ? header.keyCount : 1, sizeof(*entries));
+  if (entries == NULL) {
+    result.kern_res = kIOReturnNoMemory;
+    result.smc_res = kSMCReturnError;
+    return result;
+  }
+
+  size_t n;
+  result =
+      SMCReadAllKeyInfo(cache, transport, header.keyCount, entries, &n, conn);
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    free(entries);
+    return result;
+  }
+
+  // Enumerating filled the index-to-key table as well
+  UInt32 *indexKeys =
+      malloc((header.keyCount > 0 ? header.keyCount : 1) * sizeof(UInt32));
+  if (indexKeys == NULL) {
+    free(entries);
+    result.kern_res = kIOReturnNoMemory;
+    result.smc_res = kSMCReturnError;
+    return result;
+  }
+  SMCKeyInfoCacheIndexCopy(cache, indexKeys, header.keyCount);
+
+  qsort(entries, n, sizeof(*entries), compare_entries);
+  header.entryCount = (UInt32)n;
+
+  // Struct copies on the way here needn't keep the padding after
+  // dataAttributes zeroed, so clear it; the file then holds no stray heap
+  // bytes and is the same for the same SMC.
+  const size_t used = offsetof(SMCKeyInfoEntry_t, keyInfo.dataAttributes) +
+                         sizeof(entries[0].keyInfo.dataAttributes);
+  for (size_t i = 0; i < n; i++) {
+    memset((char *)&entries[i] + used, 0, sizeof(*entries) - used);
+  }
+
+  // The cache is filled either way, so a file that can't be written isn't an
+  // error; the next load tries again.
+  write_file(path, &header, entries, n, indexKeys);
+
+  free(indexKeys);
+  free(entries);
+  return result;
+}
+
+SMCResult_t SMCLoadKeyInfoCache(const char *path, const io_connect_t conn) {
+  return SMCCachedLoadKeyInfoCache(SMCSharedKeyInfoCache(), NULL, path, conn);
+}
@@ -0,0 +1,144 @@
+/*
+ MIT License
+
+ Copyright (c) 2025 Sriman Achanta
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include "smc.h"
+
+struct SMCPool {
+  pthread_mutex_t lock;
+  pthread_cond_t available;
+  size_t size;
+  size_t freeCount;
+  io_connect_t *all;
+  io_connect_t *free; // stack of idle connections
+};
+
+kern_return_t SMCPoolCreate(const size_t size, SMCPool_t **pool) {
+  if (size == 0 || pool == NULL) {
+    return kIOReturnBadArgument;
+  }
+
+  SMCPool_t *p = calloc(1, sizeof(SMCPool_t));
+  if (p == NULL) {
+    return kIOReturnNoMemory;
+  }
+
+  p->all = calloc(size, sizeof(io_connect_t));
+  p->free = calloc(size, sizeof(io_connect_t));
+  if (p->all == NULL || p->free == NULL) {
+    free(p->all);
+    free(p->free);
+    free(p);
+    return kIOReturnNoMemory;
+  }
+
+  for (size_t i = 0; i < size; i++) {
+    const kern_return_t result = SMCOpen(&p->all[i]);
+    if (result != kIOReturnSuccess) {
+      while (i > 0) {
+        SMCClose(p->all[--i]);
+      }
+      free(p->all);
+      free(p->free);
+      free(p);
+      return result;
+    }
+    p->free[i] = p->all[i];
+  }
+
+  pthread_mutex_init(&p->lock, NULL);
+  pthread_cond_init(&p->available, NULL);
+  p->size = size;
+  p->freeCount = size;
+
+  *pool = p;
+  return kIOReturnSuccess;
+}
+
+void SMCPoolDestroy(SMCPool_t *pool) {
+  if (pool == NULL) {
+    return;
+  }
+
+  for (size_t i = 0; i < pool->size; i++) {
+    SMCClose(pool->all[i]);
+  }
+
+  pthread_cond_destroy(&pool->available);
+  pthread_mutex_destroy(&pool->lock);
+  free(pool->all);
+  free(pool->free);
+  free(pool);
+}
+
+size_t SMCPoolSize(const SMCPool_t *pool) {
+  return pool == NULL ? 0 : pool->size;
+}
+
+io_connect_t SMCPoolAcquire(SMCPool_t *pool) {
+  pthread_mutex_lock(&pool->lock);
+  while (pool->freeCount == 0) {
+    pthread_cond_wait(&pool->available, &pool->lock);
+  }
+  const io_connect_t conn = pool->free[--pool->freeCount];
+  pthread_mutex_unlock(&pool->lock);
+
+  return conn;
+}
+
+void SMCPoolRelease(SMCPool_t *pool, const io_connect_t conn) {
+  pthread_mutex_lock(&pool->lock);
+  pool->free[pool->freeCount++] = conn;
+  pthread_cond_signal(&pool->available);
+  pthread_mutex_unlock(&pool->lock);
+}
+
+SMCResult_t SMCPoolReadKey(SMCPool_t *pool, const UInt32Char_t *key,
+                           SMCVal_t *val) {
+  const io_connect_t conn = SMCPoolAcquire(pool);
+  const SMCResult_t result = SMCReadKey(key, val, conn);
+  SMCPoolRelease(pool, conn);
+
+  return result;
+}
+
+SMCResult_t SMCPoolWriteKey(SMCPool_t *pool, const SMCVal_t *val) {
+  const io_connect_t conn = SMCPoolAcquire(pool);
+  const SMCResult_t result = SMCWriteKey(val, conn);
+  SMCPoolRelease(pool, conn);
+
+  return result;
+}
+
+kern_return_t SMCPoolReadKeys(SMCPool_t *pool, const UInt32Char_t *keys,
+                              SMCVal_t *vals, SMCResult_t *results,
+                              const size_t n) {
+  const io_connect_t conn = SMCPoolAcquire(pool);
+  const kern_return_t result = SMCReadKeys(keys, vals, results, n, conn);
+  SMCPoolRelease(pool, conn);
+
+  return result;
+}
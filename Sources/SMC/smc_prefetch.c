@@ -0,0 +1,223 @@
+/*
+ MIT License
+
+ Copyright (c) 2025 Sriman Achanta
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "smc.h"
+#include "smc_internal.h"
+
+// The SMC is a single controller, so past a handful of connections extra
+// workers only queue up in the kernel.
+#define PREFETCH_MAX_CONNECTIONS 4
+#define PREFETCH_MIN_KEYS_PER_CONNECTION 128
+
+typedef struct {
+  SMCKeyInfoCache_t *cache;
+  const SMCTransport_t *transport;
+  UInt32 keyCount;
+  _Atomic UInt32 nextIndex;
+  _Atomic int failed;
+  SMCKeyInfoEntry_t *entries;
+} PrefetchJob;
+
+typedef struct {
+  PrefetchJob *job;
+  io_connect_t conn;
+  pthread_t thread;
+  SMCResult_t result;
+} PrefetchWorker;
+
+static void prefetch_run(PrefetchWorker *worker) {
+  PrefetchJob *job = worker->job;
+
+  while (!atomic_load_explicit(&job->failed, memory_order_relaxed)) {
+    const UInt32 index =
+        atomic_fetch_add_explicit(&job->nextIndex, 1, memory_order_relaxed);
+    if (index >= job->keyCount) {
+      return;
+    }
+
+    UInt32Char_t key;
+    const SMCResult_t result =
+        SMCCachedGetKeyFromIndex(job->cache, job->transport, index,
+                                 &key, worker->conn);
+    if (result.kern_res != kIOReturnSuccess ||
+        result.smc_res != kSMCReturnSuccess) {
+      worker->result = result;
+      atomic_store_explicit(&job->failed, 1, memory_order_relaxed);
+      return;
+    }
+
+    // Keys whose info can't be read are left as empty entries.
+    SMCKeyInfoEntry_t *entry = &job->entries[index];
+    const UInt32 keyCode = FourCharCodeFromString(&key);
+    const SMCResult_t infoResult = SMCCachedGetKeyInfo(
+        job->cache, job->transport, keyCode, &entry->keyInfo, worker->conn);
+    if (infoResult.kern_res == kIOReturnSuccess &&
+        infoResult.smc_res == kSMCReturnSuccess) {
+      entry->key = keyCode;
+    }
+  }
+}
+
+static void *prefetch_thread_main(void *arg) {
+  prefetch_run(arg);
+  return NULL;
+}
+
+static int prefetch_worker_count(const UInt32 keyCount) {
+  long workers = sysconf(_SC_NPROCESSORS_ONLN);
+  if (workers > PREFETCH_MAX_CONNECTIONS) {
+    workers = PREFETCH_MAX_CONNECTIONS;
+  }
+  if (workers > (long)(keyCount / PREFETCH_MIN_KEYS_PER_CONNECTION)) {
+    workers = keyCount / PREFETCH_MIN_KEYS_PER_CONNECTION;
+  }
+  return workers < 1 ? 1 : (int)workers;
+}
+
+SMCResult_t SMCReadAllKeyInfo(SMCKeyInfoCache_t *cache,
+                              const SMCTransport_t *transport,
+                              const UInt32 keyCount, SMCKeyInfoEntry_t *entries,
+                              size_t *n, const io_connect_t conn) {
+  SMCResult_t result = {kIOReturnSuccess, kSMCReturnSuccess};
+
+  PrefetchJob job;
+  job.cache = cache;
+  job.transport = transport;
+  job.keyCount = keyCount;
+  atomic_init(&job.nextIndex, 0);
+  atomic_init(&job.failed, 0);
+  job.entries = entries;
+  memset(entries, 0, keyCount * sizeof(SMCKeyInfoEntry_t));
+
+  PrefetchWorker workers[PREFETCH_MAX_CONNECTIONS];
+  // Extra connections come from IOKit, so other transports get none.
+  const int workerCount = transport == NULL || transport == SMCIOKitTransport()
+                              ? prefetch_worker_count(keyCount)
+                              : 1;
+
+  // The caller's connection does its share on this thread; the others get a
+  // connection and a thread of their own for as long as both can be had.
+  int started = 1;
+  for (int i = 0; i < workerCount; i++) {
+    workers[i].job = &job;
+    workers[i].conn = conn;
+    workers[i].result = result;
+
+    if (i == 0) {
+      continue;
+    }
+    if (SMCOpen(&workers[i].conn) != kIOReturnSuccess) {
+      break;
+    }
+    if (pthread_create(&workers[i].thread, NULL, prefetch_thread_main,
+                       &workers[i]) != 0) {
+      SMCClose(workers[i].conn);
+      break;
+    }
+    started++;
+  }
+
+  prefetch_run(&workers[0]);
+
+  for (int i = 1; i < started; i++) {
+    pthread_join(workers[i].thread, NULL);
+    SMCClose(workers[i].conn);
+  }
+
+  for (int i = 0; i < started; i++) {
+    if (workers[i].result.kern_res != kIOReturnSuccess ||
+        workers[i].result.smc_res != kSMCReturnSuccess) {
+      return workers[i].result;
+    }
+  }
+
+  size_t count = 0;
+  for (UInt32 i = 0; i < keyCount; i++) {
+    if (entries[i].key != 0) {
+      entries[count++] = entries[i];
+    }
+  }
+  *n = count;
+
+  return result;
+}
+
+static SMCResult_t prefetch(SMCKeyInfoCache_t *cache,
+                            const SMCTransport_t *transport,
+                            const io_connect_t conn, const int freeze) {
+  UInt32 keyCount;
+
+  SMCResult_t result =
+      SMCCachedGetKeyCount(cache, transport, &keyCount, conn);
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    return result;
+  }
+
+  SMCKeyInfoEntry_t *entries =
+      malloc((keyCount > 0 ? keyCount : 1) * sizeof(SMCKeyInfoEntry_t));
+  if (entries == NULL) {
+    result.kern_res = kIOReturnNoMemory;
+    result.smc_res = kSMCReturnError;
+    return result;
+  }
+
+  size_t n;
+  result = SMCReadAllKeyInfo(cache, transport, keyCount, entries, &n, conn);
+  if (freeze && result.kern_res == kIOReturnSuccess &&
+      result.smc_res == kSMCReturnSuccess &&
+      !SMCKeyInfoCacheFreeze(cache, entries, n)) {
+    result.kern_res = kIOReturnNoMemory;
+    result.smc_res = kSMCReturnError;
+  }
+
+  free(entries);
+  return result;
+}
+
+SMCResult_t SMCCachedPrefetchKeyInfo(SMCKeyInfoCache_t *cache,
+                                     const SMCTransport_t *transport,
+                                     const io_connect_t conn) {
+  return prefetch(cache, transport, conn, 0);
+}
+
+SMCResult_t SMCCachedFreezeKeyInfo(SMCKeyInfoCache_t *cache,
+                                   const SMCTransport_t *transport,
+                                   const io_connect_t conn) {
+  return prefetch(cache, transport, conn, 1);
+}
+
+SMCResult_t SMCPrefetchKeyInfo(const io_connect_t conn) {
+  return SMCCachedPrefetchKeyInfo(SMCSharedKeyInfoCache(), NULL, conn);
+}
+
+SMCResult_t SMCFreezeKeyInfo(const io_connect_t conn) {
+  return SMCCachedFreezeKeyInfo(SMCSharedKeyInfoCache(), NULL, conn);
+}
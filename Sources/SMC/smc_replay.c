@@ -0,0 +1,436 @@
+/*
+ MIT License
+
+ Copyright (c) 2025 Sriman Achanta
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "smc.h"
+#include "smc_internal.h"
+
+#define RECORDING_MAGIC 0x534D4352 // 'SMCR'
+#define RECORDING_FORMAT 1
+#define RECORDER_INITIAL_CAPACITY 1024
+// Waits shorter than this spin on the clock rather than sleep, which can
+// overshoot by tens of microseconds.
+#define REPLAY_SPIN_NANOSECONDS 50000
+
+// Recordings hold the structs as they are laid out in memory, so recordSize
+// guards against replaying a file from a build with a different layout.
+typedef struct {
+  UInt32 magic;
+  UInt32 format;
+  UInt32 recordSize;
+  UInt32 recordCount;
+} RecordingHeader;
+
+// A call is identified by its command, key and index argument; writes and the
+// bytes they carry aren't part of the match.
+typedef struct {
+  UInt32 key;
+  UInt32 data32;
+  UInt8 command;
+  UInt8 reserved[3];
+  // The call's position in the recording.
+  UInt32 sequence;
+  kern_return_t kernRes;
+  UInt64 latency;
+  SMCKeyData_t output;
+} RecordedCall;
+
+struct SMCRecorder {
+  SMCTransport_t transport;
+  const SMCTransport_t *inner;
+  pthread_mutex_t lock;
+  RecordedCall *calls;
+  size_t count;
+  size_t capacity;
+};
+
+// The recorded calls answering one kind of request, in recorded order. next
+// cycles through them so a workload longer than the recording keeps going.
+typedef struct {
+  UInt32 first;
+  UInt32 count;
+  _Atomic UInt32 next;
+} ReplayGroup;
+
+struct SMCReplay {
+  SMCTransport_t transport;
+  RecordedCall *calls;
+  UInt32 callCount;
+  ReplayGroup *groups;
+  UInt32 groupCount;
+  _Atomic UInt64 misses;
+  // A replayed call takes recordedScale times its recorded latency plus
+  // extraNanoseconds. The scale is kept in thousandths.
+  _Atomic UInt64 recordedScaleMilli;
+  _Atomic UInt64 extraNanoseconds;
+};
+
+static int compare_calls(const RecordedCall *a, const RecordedCall *b) {
+  if (a->command != b->command) {
+    return a->command < b->command ? -1 : 1;
+  }
+  if (a->key != b->key) {
+    return a->key < b->key ? -1 : 1;
+  }
+  if (a->data32 != b->data32) {
+    return a->data32 < b->data32 ? -1 : 1;
+  }
+  return 0;
+}
+
+static void wait_nanoseconds(const UInt64 nanoseconds) {
+  if (nanoseconds == 0) {
+    return;
+  }
+
+  const UInt64 deadline = clock_gettime_nsec_np(CLOCK_UPTIME_RAW) + nanoseconds;
+  if (nanoseconds > REPLAY_SPIN_NANOSECONDS) {
+    const UInt64 sleep = nanoseconds - REPLAY_SPIN_NANOSECONDS;
+    const struct timespec ts = {(time_t)(sleep / 1000000000),
+                                (long)(sleep % 1000000000)};
+    nanosleep(&ts, NULL);
+  }
+  while (clock_gettime_nsec_np(CLOCK_UPTIME_RAW) < deadline) {
+  }
+}
+
+static kern_return_t recorder_open(void *context, io_connect_t *conn) {
+  const SMCRecorder_t *recorder = context;
+  return recorder->inner->open(recorder->inner->context, conn);
+}
+
+static void recorder_close(void *context, const io_connect_t conn) {
+  const SMCRecorder_t *recorder = context;
+  recorder->inner->close(recorder->inner->context, conn);
+}
+
+static kern_return_t recorder_call(void *context, const io_connect_t conn,
+                                   const int selector,
+                                   const SMCKeyData_t *inputStructure,
+                                   SMCKeyData_t *outputStructure) {
+  SMCRecorder_t *recorder = context;
+
+  const UInt64 start = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+  const kern_return_t result =
+      recorder->inner->call(recorder->inner->context, conn, selector,
+                            inputStructure, outputStructure);
+  const UInt64 end = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+
+  pthread_mutex_lock(&recorder->lock);
+
+  if (recorder->count == recorder->capacity) {
+    const size_t capacity = recorder->capacity * 2;
+    RecordedCall *calls =
+        realloc(recorder->calls, capacity * sizeof(RecordedCall));
+    if (calls == NULL) {
+      // Drop the call from the recording rather than fail the caller.
+      pthread_mutex_unlock(&recorder->lock);
+      return result;
+    }
+    recorder->calls = calls;
+    recorder->capacity = capacity;
+  }
+
+  RecordedCall *call = &recorder->calls[recorder->count++];
+  memset(call, 0, sizeof(RecordedCall));
+  call->key = inputStructure->key;
+  call->data32 = inputStructure->data32;
+  call->command = inputStructure->data8;
+  call->sequence = (UInt32)(recorder->count - 1);
+  call->kernRes = result;
+  call->latency = end - start;
+  call->output = *outputStructure;
+
+  pthread_mutex_unlock(&recorder->lock);
+  return result;
+}
+
+kern_return_t SMCRecorderCreate(const SMCTransport_t *inner,
+                                SMCRecorder_t **recorder) {
+  if (recorder == NULL) {
+    return kIOReturnBadArgument;
+  }
+  *recorder = NULL;
+
+  SMCRecorder_t *created = calloc(1, sizeof(SMCRecorder_t));
+  if (created == NULL) {
+    return kIOReturnNoMemory;
+  }
+
+  created->calls = malloc(RECORDER_INITIAL_CAPACITY * sizeof(RecordedCall));
+  if (created->calls == NULL) {
+    free(created);
+    return kIOReturnNoMemory;
+  }
+  created->capacity = RECORDER_INITIAL_CAPACITY;
+  created->inner = inner != NULL ? inner : SMCIOKitTransport();
+  pthread_mutex_init(&created->lock, NULL);
+
+  created->transport.open = recorder_open;
+  created->transport.close = recorder_close;
+  created->transport.call = recorder_call;
+  created->transport.context = created;
+
+  *recorder = created;
+  return kIOReturnSuccess;
+}
+
+void SMCRecorderDestroy(SMCRecorder_t *recorder) {
+  if (recorder == NULL) {
+    return;
+  }
+
+  pthread_mutex_destroy(&recorder->lock);
+  free(recorder->calls);
+  free(recorder);
+}
+
+const SMCTransport_t *SMCRecorderTransport(SMCRecorder_t *recorder) {
+  return recorder != NULL ? &recorder->transport : NULL;
+}
+
+size_t SMCRecorderCount(SMCRecorder_t *recorder) {
+  if (recorder == NULL) {
+    return 0;
+  }
+
+  pthread_mutex_lock(&recorder->lock);
+  const size_t count = recorder->count;
+  pthread_mutex_unlock(&recorder->lock);
+  return count;
+}
+
+kern_return_t SMCRecorderSave(SMCRecorder_t *recorder, const char *path) {
+  if (recorder == NULL || path == NULL) {
+    return kIOReturnBadArgument;
+  }
+
+  pthread_mutex_lock(&recorder->lock);
+
+  const RecordingHeader header = {
+      .magic = RECORDING_MAGIC,
+      .format = RECORDING_FORMAT,
+      .recordSize = sizeof(RecordedCall),
+      .recordCount = (UInt32)recorder->count,
+  };
+  const void *parts[] = {&header, recorder->calls};
+  const size_t sizes[] = {sizeof(header),
+                          recorder->count * sizeof(RecordedCall)};
+  const int ok = SMCWriteFileAtomically(path, parts, sizes, 2);
+
+  pthread_mutex_unlock(&recorder->lock);
+  return ok ? kIOReturnSuccess : kIOReturnIOError;
+}
+
+static kern_return_t replay_open(void *context, io_connect_t *conn) {
+  (void)context;
+  // Replay needs no connection; calls reach it through the context.
+  *conn = MACH_PORT_NULL;
+  return kIOReturnSuccess;
+}
+
+static void replay_close(void *context, const io_connect_t conn) {
+  (void)context;
+  (void)conn;
+}
+
+static kern_return_t replay_call(void *context, const io_connect_t conn,
+                                 const int selector,
+                                 const SMCKeyData_t *inputStructure,
+                                 SMCKeyData_t *outputStructure) {
+  (void)conn;
+  (void)selector;
+  SMCReplay_t *replay = context;
+
+  RecordedCall probe;
+  probe.key = inputStructure->key;
+  probe.data32 = inputStructure->data32;
+  probe.command = inputStructure->data8;
+
+  UInt32 lo = 0;
+  UInt32 hi = replay->groupCount;
+  while (lo < hi) {
+    const UInt32 mid = lo + (hi - lo) / 2;
+    const int order =
+        compare_calls(&replay->calls[replay->groups[mid].first], &probe);
+    if (order == 0) {
+      lo = mid;
+      break;
+    }
+    if (order < 0) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  if (lo >= replay->groupCount ||
+      compare_calls(&replay->calls[replay->groups[lo].first], &probe) != 0) {
+    atomic_fetch_add_explicit(&replay->misses, 1, memory_order_relaxed);
+    memset(outputStructure, 0, sizeof(SMCKeyData_t));
+    outputStructure->result = kSMCReturnKeyNotFound;
+    return kIOReturnSuccess;
+  }
+
+  ReplayGroup *group = &replay->groups[lo];
+  const UInt32 n =
+      atomic_fetch_add_explicit(&group->next, 1, memory_order_relaxed);
+  const RecordedCall *call = &replay->calls[group->first + n % group->count];
+
+  const UInt64 scaleMilli =
+      atomic_load_explicit(&replay->recordedScaleMilli, memory_order_relaxed);
+  const UInt64 extra =
+      atomic_load_explicit(&replay->extraNanoseconds, memory_order_relaxed);
+  wait_nanoseconds(call->latency * scaleMilli / 1000 + extra);
+
+  *outputStructure = call->output;
+  return call->kernRes;
+}
+
+static int calls_in_order(const void *a, const void *b) {
+  const RecordedCall *x = a;
+  const RecordedCall *y = b;
+
+  const int order = compare_calls(x, y);
+  if (order != 0) {
+    return order;
+  }
+  return (x->sequence > y->sequence) - (x->sequence < y->sequence);
+}
+
+kern_return_t SMCReplayOpen(const char *path, SMCReplay_t **replay) {
+  if (path == NULL || replay == NULL) {
+    return kIOReturnBadArgument;
+  }
+  *replay = NULL;
+
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return kIOReturnNotFound;
+  }
+
+  RecordingHeader header;
+  struct stat st;
+  const int valid =
+      read(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+      fstat(fd, &st) == 0 && header.magic == RECORDING_MAGIC &&
+      header.format == RECORDING_FORMAT &&
+      header.recordSize == sizeof(RecordedCall) &&
+      (size_t)st.st_size ==
+          sizeof(header) + (size_t)header.recordCount * sizeof(RecordedCall);
+  if (!valid) {
+    close(fd);
+    return kIOReturnBadMedia;
+  }
+
+  SMCReplay_t *opened = calloc(1, sizeof(SMCReplay_t));
+  const size_t size = (size_t)header.recordCount * sizeof(RecordedCall);
+  RecordedCall *calls = malloc(size > 0 ? size : 1);
+  ReplayGroup *groups =
+      malloc((header.recordCount > 0 ? header.recordCount : 1) *
+             sizeof(ReplayGroup));
+  if (opened == NULL || calls == NULL || groups == NULL) {
+    close(fd);
+    free(opened);
+    free(calls);
+    free(groups);
+    return kIOReturnNoMemory;
+  }
+
+  const int complete = read(fd, calls, size) == (ssize_t)size;
+  close(fd);
+  if (!complete) {
+    free(opened);
+    free(calls);
+    free(groups);
+    return kIOReturnIOError;
+  }
+
+  qsort(calls, header.recordCount, sizeof(RecordedCall), calls_in_order);
+
+  UInt32 groupCount = 0;
+  for (UInt32 i = 0; i < header.recordCount; i++) {
+    if (i == 0 || compare_calls(&calls[i - 1], &calls[i]) != 0) {
+      groups[groupCount].first = i;
+      groups[groupCount].count = 0;
+      atomic_init(&groups[groupCount].next, 0);
+      groupCount++;
+    }
+    groups[groupCount - 1].count++;
+  }
+
+  opened->calls = calls;
+  opened->callCount = header.recordCount;
+  opened->groups = groups;
+  opened->groupCount = groupCount;
+
+  opened->transport.open = replay_open;
+  opened->transport.close = replay_close;
+  opened->transport.call = replay_call;
+  opened->transport.context = opened;
+
+  *replay = opened;
+  return kIOReturnSuccess;
+}
+
+void SMCReplayClose(SMCReplay_t *replay) {
+  if (replay == NULL) {
+    return;
+  }
+
+  free(replay->calls);
+  free(replay->groups);
+  free(replay);
+}
+
+const SMCTransport_t *SMCReplayTransport(SMCReplay_t *replay) {
+  return replay != NULL ? &replay->transport : NULL;
+}
+
+void SMCReplaySetLatency(SMCReplay_t *replay, const double recordedScale,
+                         const UInt64 extraNanoseconds) {
+  if (replay == NULL) {
+    return;
+  }
+
+  const double scale = recordedScale > 0 ? recordedScale : 0;
+  atomic_store_explicit(&replay->recordedScaleMilli,
+                        (UInt64)(scale * 1000 + 0.5), memory_order_relaxed);
+  atomic_store_explicit(&replay->extraNanoseconds, extraNanoseconds,
+                        memory_order_relaxed);
+}
+
+UInt64 SMCReplayMisses(const SMCReplay_t *replay) {
+  return replay != NULL ? atomic_load_explicit(&replay->misses,
+                                               memory_order_relaxed)
+                        : 0;
+}
@@ -0,0 +1,312 @@
+/*
+ MIT License
+
+ Copyright (c) 2025 Sriman Achanta
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "smc.h"
+#include "smc_internal.h"
+
+#define SNAPSHOT_MAGIC 0x534D4353 // 'SMCS'
+#define SNAPSHOT_FORMAT 1
+
+// keyCount is the number of keys the SMC reported; recordCount can be lower
+// if some indices couldn't be enumerated. The header is padded to the size of
+// a record so the records that follow stay aligned.
+typedef struct {
+  UInt32 magic;
+  UInt32 format;
+  UInt32 recordCount;
+  UInt32 keyCount;
+  UInt64 timestamp;
+  SMCKeyData_vers_t vers;
+  UInt8 reserved[18];
+} SnapshotHeader;
+
+_Static_assert(sizeof(SnapshotHeader) == 48, "snapshot header layout");
+_Static_assert(sizeof(SMCSnapshotRecord_t) == 48, "snapshot record layout");
+
+struct SMCSnapshot {
+  void *map;
+  size_t size;
+  const SnapshotHeader *header;
+  const SMCSnapshotRecord_t *records;
+};
+
+static int compare_records(const void *a, const void *b) {
+  const UInt32 lhs = ((const SMCSnapshotRecord_t *)a)->key;
+  const UInt32 rhs = ((const SMCSnapshotRecord_t *)b)->key;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+SMCResult_t SMCCachedWriteSnapshot(SMCKeyInfoCache_t *cache,
+                                   const SMCTransport_t *transport,
+                                   const char *path, const io_connect_t conn) {
+  SMCResult_t result = {kIOReturnBadArgument, kSMCReturnError};
+
+  if (path == NULL) {
+    return result;
+  }
+
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = SNAPSHOT_MAGIC;
+  header.format = SNAPSHOT_FORMAT;
+  header.timestamp = (UInt64)time(NULL);
+
+  // Left zeroed if the firmware doesn't report a version.
+  result = SMCCachedReadVersion(cache, transport, &header.vers, conn);
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    memset(&header.vers, 0, sizeof(header.vers));
+  }
+
+  // Fetches every key's info over several connections and fills the
+  // index-to-key table, so enumerating below doesn't go back to the SMC.
+  result = SMCCachedPrefetchKeyInfo(cache, transport, conn);
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    return result;
+  }
+
+  result = SMCCachedGetKeyCount(cache, transport, &header.keyCount, conn);
+  if (result.kern_res != kIOReturnSuccess ||
+      result.smc_res != kSMCReturnSuccess) {
+    return result;
+  }
+
+  const size_t capacity = header.keyCount > 0 ? header.keyCount : 1;
+  UInt32Char_t *keys = malloc(capacity * sizeof(UInt32Char_t));
+  SMCVal_t *vals = malloc(capacity * sizeof(SMCVal_t));
+  SMCResult_t *results = malloc(capacity * sizeof(SMCResult_t));
+  SMCSnapshotRecord_t *records = calloc(capacity, sizeof(SMCSnapshotRecord_t));
+  if (keys == NULL || vals == NULL || results == NULL || records == NULL) {
+    result.kern_res = kIOReturnNoMemory;
+    result.smc_res = kSMCReturnError;
+    goto done;
+  }
+
+  size_t n = 0;
+  for (UInt32 i = 0; i < header.keyCount; i++) {
+    const SMCResult_t indexResult =
+        SMCCachedGetKeyFromIndex(cache, transport, i, &keys[n], conn);
+    if (indexResult.kern_res == kIOReturnSuccess &&
+        indexResult.smc_res == kSMCReturnSuccess) {
+      n++;
+    }
+  }
+
+  result.kern_res =
+      SMCCachedReadKeys(cache, transport, keys, vals, results, n, conn);
+  if (result.kern_res != kIOReturnSuccess) {
+    goto done;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    SMCSnapshotRecord_t *record = &records[i];
+    record->key = FourCharCodeFromString(&keys[i]);
+    record->dataType = FourCharCodeFromString(&vals[i].dataType);
+    record->dataSize = vals[i].dataSize;
+    record->status = results[i].kern_res == kIOReturnSuccess
+                         ? results[i].smc_res
+                         : kSMCReturnError;
+
+    SMCKeyData_keyInfo_t keyInfo;
+    const SMCResult_t infoResult =
+        SMCCachedGetKeyInfo(cache, transport, record->key, &keyInfo, conn);
+    if (infoResult.kern_res == kIOReturnSuccess &&
+        infoResult.smc_res == kSMCReturnSuccess) {
+      record->dataAttributes = keyInfo.dataAttributes;
+    }
+
+    if (record->status == kSMCReturnSuccess) {
+      memcpy(record->bytes, vals[i].bytes, sizeof(record->bytes));
+    }
+  }
+
+  qsort(records, n, sizeof(SMCSnapshotRecord_t), compare_records);
+  header.recordCount = (UInt32)n;
+
+  const void *const parts[] = {&header, records};
+  const size_t sizes[] = {sizeof(header), n * sizeof(SMCSnapshotRecord_t)};
+  if (!SMCWriteFileAtomically(path, parts, sizes, 2)) {
+    result.kern_res = kIOReturnIOError;
+    result.smc_res = kSMCReturnError;
+  } else {
+    result.kern_res = kIOReturnSuccess;
+    result.smc_res = kSMCReturnSuccess;
+  }
+
+done:
+  free(records);
+  free(results);
+  free(vals);
+  free(keys);
+  return result;
+}
+
+SMCResult_t SMCWriteSnapshot(const char *path, const io_connect_t conn) {
+  return SMCCachedWriteSnapshot(SMCSharedKeyInfoCache(), NULL, path, conn);
+}
+
+kern_return_t SMCSnapshotOpen(const char *path, SMCSnapshot_t **snapshot) {
+  if (path == NULL || snapshot == NULL) {
+    return kIOReturnBadArgument;
+  }
+  *snapshot = NULL;
+
+  const int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return kIOReturnNotFound;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SnapshotHeader)) {
+    close(fd);
+    return kIOReturnBadMedia;
+  }
+
+  const size_t size = (size_t)st.st_size;
+  void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (map == MAP_FAILED) {
+    return kIOReturnIOError;
+  }
+
+  const SnapshotHeader *header = map;
+  const SMCSnapshotRecord_t *records =
+      (const SMCSnapshotRecord_t *)((const char *)map +
+                                    sizeof(SnapshotHeader));
+  int valid = header->magic == SNAPSHOT_MAGIC &&
+              header->format == SNAPSHOT_FORMAT &&
+              size == sizeof(SnapshotHeader) + (size_t)header->recordCount *
+                                                   sizeof(SMCSnapshotRecord_t);
+
+  // Lookups binary-search the records, so refuse a file that isn't sorted.
+  for (UInt32 i = 1; valid && i < header->recordCount; i++) {
+    valid = records[i - 1].key < records[i].key;
+  }
+
+  SMCSnapshot_t *opened = valid ? malloc(sizeof(SMCSnapshot_t)) : NULL;
+  if (opened == NULL) {
+    munmap(map, size);
+    return valid ? kIOReturnNoMemory : kIOReturnBadMedia;
+  }
+
+  opened->map = map;
+  opened->size = size;
+  opened->header = header;
+  opened->records = records;
+  *snapshot = opened;
+  return kIOReturnSuccess;
+}
+
+void SMCSnapshotClose(SMCSnapshot_t *snapshot) {
+  if (snapshot == NULL) {
+    return;
+  }
+
+  munmap(snapshot->map, snapshot->size);
+  free(snapshot);
+}
+
+SMCKeyData_vers_t SMCSnapshotVersion(const SMCSnapshot_t *snapshot) {
+  return snapshot->header->vers;
+}
+
+UInt64 SMCSnapshotTimestamp(const SMCSnapshot_t *snapshot) {
+  return snapshot->header->timestamp;
+}
+
+UInt32 SMCSnapshotCount(const SMCSnapshot_t *snapshot) {
+  return snapshot->header->recordCount;
+}
+
+const SMCSnapshotRecord_t *SMCSnapshotRecords(const SMCSnapshot_t *snapshot) {
+  return snapshot->records;
+}
+
+const SMCSnapshotRecord_t *SMCSnapshotFind(const SMCSnapshot_t *snapshot,
+                                           const UInt32 key) {
+  UInt32 lo = 0;
+  UInt32 hi = snapshot->header->recordCount;
+
+  while (lo < hi) {
+    const UInt32 mid = lo + (hi - lo) / 2;
+    const UInt32 midKey = snapshot->records[mid].key;
+    if (midKey == key) {
+      return &snapshot->records[mid];
+    }
+    if (midKey < key) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return NULL;
+}
+
+static int records_differ(const SMCSnapshotRecord_t *a,
+                          const SMCSnapshotRecord_t *b) {
+  if (a->dataType != b->dataType || a->dataSize != b->dataSize ||
+      a->status != b->status) {
+    return 1;
+  }
+
+  const size_t size =
+      a->dataSize < sizeof(a->bytes) ? a->dataSize : sizeof(a->bytes);
+  return memcmp(a->bytes, b->bytes, size) != 0;
+}
+
+void SMCSnapshotDiff(const SMCSnapshot_t *a, const SMCSnapshot_t *b,
+                     const SMCSnapshotDiffFn fn, void *context) {
+  if (a == NULL || b == NULL || fn == NULL) {
+    return;
+  }
+
+  const SMCSnapshotRecord_t *ra = a->records;
+  const SMCSnapshotRecord_t *rb = b->records;
+  const SMCSnapshotRecord_t *endA = ra + a->header->recordCount;
+  const SMCSnapshotRecord_t *endB = rb + b->header->recordCount;
+
+  // Both are sorted by key, so a single merge pass pairs them up.
+  while (ra < endA || rb < endB) {
+    if (rb == endB || (ra < endA && ra->key < rb->key)) {
+      fn(ra++, NULL, context);
+    } else if (ra == endA || rb->key < ra->key) {
+      fn(NULL, rb++, context);
+    } else {
+      if (records_differ(ra, rb)) {
+        fn(ra, rb, context);
+      }
+      ra++;
+      rb++;
+    }
+  }
+}
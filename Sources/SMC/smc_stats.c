@@ -0,0 +1,230 @@
+/*
+ MIT License
+
+ Copyright (c) 2025 Sriman Achanta
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include <os/signpost.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include "smc.h"
+#include "smc_internal.h"
+
+// Counters are plain relaxed atomics: a snapshot taken while commands are in
+// flight may be off by those commands, which is fine for statistics.
+
+_Atomic int g_smcInstrumentation = 0;
+
+static _Atomic UInt64 g_calls[SMC_STATS_COMMANDS];
+static _Atomic UInt64 g_latency[SMC_STATS_COMMANDS][SMC_STATS_LATENCY_BUCKETS];
+static _Atomic UInt64 g_counters[SMC_STAT_COUNTER_COUNT];
+static _Atomic UInt64 g_smcErrors[256];
+
+// Distinct kernel errors are few, so they get a small table claimed by
+// compare-and-swap. 0 (kIOReturnSuccess) marks a free entry.
+static _Atomic kern_return_t g_kernErrorCodes[SMC_STATS_KERN_ERRORS];
+static _Atomic UInt64 g_kernErrorCounts[SMC_STATS_KERN_ERRORS];
+
+static os_log_t g_signpostLog;
+static pthread_once_t g_signpostLogOnce = PTHREAD_ONCE_INIT;
+
+static void signpost_log_create(void) {
+  g_signpostLog = os_log_create("com.srimanachanta.SMCKit", "SMC");
+}
+
+static void set_flag(const int flag, const bool enabled) {
+  if (enabled) {
+    atomic_fetch_or_explicit(&g_smcInstrumentation, flag, memory_order_relaxed);
+  } else {
+    atomic_fetch_and_explicit(&g_smcInstrumentation, ~flag,
+                              memory_order_relaxed);
+  }
+}
+
+void SMCSetStatsEnabled(const bool enabled) {
+  set_flag(SMC_INSTRUMENT_STATS, enabled);
+}
+
+bool SMCStatsEnabled(void) {
+  return (SMCInstrumentation() & SMC_INSTRUMENT_STATS) != 0;
+}
+
+void SMCSetSignpostsEnabled(const bool enabled) {
+  if (enabled) {
+    pthread_once(&g_signpostLogOnce, signpost_log_create);
+  }
+  set_flag(SMC_INSTRUMENT_SIGNPOSTS, enabled);
+}
+
+void SMCStatsIncrement(const SMCStatCounter counter) {
+  atomic_fetch_add_explicit(&g_counters[counter], 1, memory_order_relaxed);
+}
+
+static unsigned latency_bucket(const UInt64 ns) {
+  if (ns == 0) {
+    return 0;
+  }
+  const unsigned bucket = 63 - (unsigned)__builtin_clzll(ns);
+  return bucket < SMC_STATS_LATENCY_BUCKETS ? bucket
+                                            : SMC_STATS_LATENCY_BUCKETS - 1;
+}
+
+static void count_kern_error(const kern_return_t code) {
+  for (unsigned i = 0; i < SMC_STATS_KERN_ERRORS; i++) {
+    kern_return_t slot =
+        atomic_load_explicit(&g_kernErrorCodes[i], memory_order_relaxed);
+    // If another thread claims the entry first, slot receives its code.
+    if (slot == kIOReturnSuccess &&
+        atomic_compare_exchange_strong_explicit(&g_kernErrorCodes[i], &slot,
+                                                code, memory_order_relaxed,
+                                                memory_order_relaxed)) {
+      slot = code;
+    }
+    if (slot == code) {
+      atomic_fetch_add_explicit(&g_kernErrorCounts[i], 1, memory_order_relaxed);
+      return;
+    }
+  }
+}
+
+static void record_call(const UInt8 command, const UInt64 ns,
+                        const kern_return_t kern_res,
+                        const smc_return_t smc_res) {
+  // Unknown commands share the slot of command 0, which the SMC doesn't use.
+  const unsigned index = command < SMC_STATS_COMMANDS ? command : 0;
+
+  atomic_fetch_add_explicit(&g_calls[index], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&g_latency[index][latency_bucket(ns)], 1,
+                            memory_order_relaxed);
+
+  if (kern_res != kIOReturnSuccess) {
+    count_kern_error(kern_res);
+  } else if (smc_res != kSMCReturnSuccess) {
+    atomic_fetch_add_explicit(&g_smcErrors[smc_res], 1, memory_order_relaxed);
+  }
+}
+
+kern_return_t SMCInstrumentedCall(const int flags,
+                                  const SMCTransport_t *transport,
+                                  const int selector,
+                                  const SMCKeyData_t *inputStructure,
+                                  SMCKeyData_t *outputStructure,
+                                  const io_connect_t conn) {
+  const bool signposts =
+      (flags & SMC_INSTRUMENT_SIGNPOSTS) != 0 && g_signpostLog != NULL;
+  os_signpost_id_t signpost = 0;
+  if (signposts) {
+    UInt32Char_t key;
+    StringFromFourCharCode(inputStructure->key, &key);
+    signpost = os_signpost_id_generate(g_signpostLog);
+    os_signpost_interval_begin(g_signpostLog, signpost, "SMCCall",
+                               "command %u key %{public}s",
+                               inputStructure->data8, key.chars);
+  }
+
+  // Signposts carry their own timestamps; only counting needs the clock.
+  const bool stats = (flags & SMC_INSTRUMENT_STATS) != 0;
+  const UInt64 start = stats ? clock_gettime_nsec_np(CLOCK_UPTIME_RAW) : 0;
+  const kern_return_t result = SMCTransportDispatch(
+      transport, selector, inputStructure, outputStructure, conn);
+  const UInt64 end = stats ? clock_gettime_nsec_np(CLOCK_UPTIME_RAW) : 0;
+
+  if (signposts) {
+    os_signpost_interval_end(g_signpostLog, signpost, "SMCCall", "result %d/%u",
+                             result, outputStructure->result);
+  }
+
+  if (stats) {
+    record_call(inputStructure->data8, end - start, result,
+                outputStructure->result);
+  }
+
+  return result;
+}
+
+void SMCGetStats(SMCStats_t *stats) {
+  if (stats == NULL) {
+    return;
+  }
+
+  memset(stats, 0, sizeof(SMCStats_t));
+
+  for (unsigned i = 0; i < SMC_STATS_COMMANDS; i++) {
+    stats->calls[i] = atomic_load_explicit(&g_calls[i], memory_order_relaxed);
+    for (unsigned b = 0; b < SMC_STATS_LATENCY_BUCKETS; b++) {
+      stats->latency[i][b] =
+          atomic_load_explicit(&g_latency[i][b], memory_order_relaxed);
+    }
+  }
+
+  stats->cacheHits = atomic_load_explicit(&g_counters[SMC_STAT_CACHE_HIT],
+                                          memory_order_relaxed);
+  stats->cacheAbsentHits = atomic_load_explicit(
+      &g_counters[SMC_STAT_CACHE_ABSENT_HIT], memory_order_relaxed);
+  stats->cacheMisses = atomic_load_explicit(&g_counters[SMC_STAT_CACHE_MISS],
+                                            memory_order_relaxed);
+  stats->cacheInserts = atomic_load_explicit(
+      &g_counters[SMC_STAT_CACHE_INSERT], memory_order_relaxed);
+  stats->cacheEvictions = atomic_load_explicit(
+      &g_counters[SMC_STAT_CACHE_EVICTION], memory_order_relaxed);
+
+  for (unsigned i = 0; i < 256; i++) {
+    stats->smcErrors[i] =
+        atomic_load_explicit(&g_smcErrors[i], memory_order_relaxed);
+  }
+
+  for (unsigned i = 0; i < SMC_STATS_KERN_ERRORS; i++) {
+    const kern_return_t code =
+        atomic_load_explicit(&g_kernErrorCodes[i], memory_order_relaxed);
+    if (code == kIOReturnSuccess) {
+      break;
+    }
+    stats->kernErrors[i].code = code;
+    stats->kernErrors[i].count =
+        atomic_load_explicit(&g_kernErrorCounts[i], memory_order_relaxed);
+    stats->kernErrorCount++;
+  }
+}
+
+void SMCResetStats(void) {
+  for (unsigned i = 0; i < SMC_STATS_COMMANDS; i++) {
+    atomic_store_explicit(&g_calls[i], 0, memory_order_relaxed);
+    for (unsigned b = 0; b < SMC_STATS_LATENCY_BUCKETS; b++) {
+      atomic_store_explicit(&g_latency[i][b], 0, memory_order_relaxed);
+    }
+  }
+  for (unsigned i = 0; i < SMC_STAT_COUNTER_COUNT; i++) {
+    atomic_store_explicit(&g_counters[i], 0, memory_order_relaxed);
+  }
+  for (unsigned i = 0; i < 256; i++) {
+    atomic_store_explicit(&g_smcErrors[i], 0, memory_order_relaxed);
+  }
+  // Clear the counts before releasing the codes so a concurrent claim of a
+  // freed entry doesn't inherit a stale count.
+  for (unsigned i = 0; i < SMC_STATS_KERN_ERRORS; i++) {
+    atomic_store_explicit(&g_kernErrorCounts[i], 0, memory_order_relaxed);
+    atomic_store_explicit(&g_kernErrorCodes[i], kIOReturnSuccess,
+                          memory_order_relaxed);
+  }
+}
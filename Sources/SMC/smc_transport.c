@@ -0,0 +1,54 @@
+/*
+ MIT License
+
+ Copyright (c) 2025 Sriman Achanta
+
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+*/
+
+#include "smc.h"
+#include "smc_internal.h"
+
+static kern_return_t iokit_open(void *context, io_connect_t *conn) {
+  (void)context;
+  return SMCOpen(conn);
+}
+
+static void iokit_close(void *context, const io_connect_t conn) {
+  (void)context;
+  SMCClose(conn);
+}
+
+static kern_return_t iokit_call(void *context, const io_connect_t conn,
+                                const int selector,
+                                const SMCKeyData_t *inputStructure,
+                                SMCKeyData_t *outputStructure) {
+  (void)context;
+  return SMCTransportDispatch(NULL, selector, inputStructure, outputStructure,
+                              conn);
+}
+
+static const SMCTransport_t g_iokitTransport = {
+    .open = iokit_open,
+    .close = iokit_close,
+    .call = iokit_call,
+    .context = NULL,
+};
+
+const SMCTransport_t *SMCIOKitTransport(void) { return &g_iokitTransport; }
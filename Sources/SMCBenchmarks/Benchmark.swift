@@ -0,0 +1,241 @@
+import Darwin
+import Foundation
+import Dispatch
+
+/// Keeps the optimizer from discarding a benchmarked result.
+@inline(never)
+func blackHole<T>(_ value: T) {
+    withExtendedLifetime(value) {}
+}
+
+func now() -> UInt64 {
+    clock_gettime_nsec_np(CLOCK_UPTIME_RAW)
+}
+
+/// Counts calls to malloc, calloc and realloc on every thread, including
+/// allocations freed again straight away, by installing libmalloc's
+/// `malloc_logger`: the hook it reports each allocation to for Instruments.
+enum AllocationCounter {
+    typealias Logger = @convention(c) (UInt32, UInt, UInt, UInt, UInt, UInt32) -> Void
+
+    /// `malloc_logger` has no header, so it is looked up by name.
+    private static let hook = dlsym(UnsafeMutableRawPointer(bitPattern: -2), "malloc_logger")?
+        .assumingMemoryBound(to: Logger?.self)
+
+    // The logger runs inside malloc, so it only touches memory set up before it
+    // is installed and never allocates.
+    private static let lock: UnsafeMutablePointer<os_unfair_lock> = {
+        let lock = UnsafeMutablePointer<os_unfair_lock>.allocate(capacity: 1)
+        lock.initialize(to: os_unfair_lock())
+        return lock
+    }()
+    private static let count: UnsafeMutablePointer<Int> = {
+        let count = UnsafeMutablePointer<Int>.allocate(capacity: 1)
+        count.initialize(to: 0)
+        return count
+    }()
+    private static let previous: UnsafeMutablePointer<Logger?> = {
+        let previous = UnsafeMutablePointer<Logger?>.allocate(capacity: 1)
+        previous.initialize(to: nil)
+        return previous
+    }()
+
+    private static let logger: Logger = { type, zone, size, pointer, result, skip in
+        // MALLOC_LOG_TYPE_ALLOCATE, set for realloc as well
+        if type & 0x2 != 0 {
+            os_unfair_lock_lock(AllocationCounter.lock)
+            AllocationCounter.count.pointee += 1
+            os_unfair_lock_unlock(AllocationCounter.lock)
+        }
+        AllocationCounter.previous.pointee?(type, zone, size, pointer, result, skip + 1)
+    }
+
+    /// Starts counting from zero. Does nothing if the hook can't be found.
+    static func start() {
+        guard let hook else { return }
+        os_unfair_lock_lock(lock)
+        count.pointee = 0
+        os_unfair_lock_unlock(lock)
+        previous.pointee = hook.pointee
+        hook.pointee = logger
+    }
+
+    /// Stops counting and returns the allocations since `start`, or nil if
+    /// they couldn't be counted.
+    static func stop() -> Int? {
+        guard let hook else { return nil }
+        hook.pointee = previous.pointee
+
+        os_unfair_lock_lock(lock)
+        defer { os_unfair_lock_unlock(lock) }
+        return count.pointee
+    }
+}
+
+struct Measurement {
+    let name: String
+    /// Nanoseconds per operation, one entry per sample.
+    let samples: [Double]
+    let operations: Int
+    let elapsed: UInt64
+    /// Allocations made during the timed operations, if counted.
+    var allocations: Int? = nil
+
+    func percentile(_ p: Double) -> Double {
+        let sorted = samples.sorted()
+        return sorted[min(sorted.count - 1, Int(Double(sorted.count) * p))]
+    }
+
+    var throughput: Double {
+        Double(operations) / (Double(elapsed) / 1e9)
+    }
+
+    var allocationsPerOperation: Double? {
+        allocations.map { Double($0) / Double(max(1, operations)) }
+    }
+
+    func report() {
+        let label = name.padding(toLength: 48, withPad: " ", startingAt: 0)
+        let allocs = allocationsPerOperation.map { "  \(format($0, width: 8)) allocs/op" } ?? ""
+        if samples.isEmpty {
+            print("\(label) \(format(throughput, width: 14)) ops/s\(allocs)")
+        } else {
+            print(
+                "\(label) p50 \(format(percentile(0.5), width: 10)) ns"
+                    + "  p99 \(format(percentile(0.99), width: 10)) ns"
+                    + "  \(format(throughput, width: 14)) ops/s\(allocs)"
+            )
+        }
+    }
+
+    private func format(_ value: Double, width: Int) -> String {
+        let text = value >= 100 ? String(Int(value.rounded())) : String((value * 10).rounded() / 10)
+        return String(repeating: " ", count: max(0, width - text.count)) + text
+    }
+}
+
+func section(_ title: String) {
+    print("\n== \(title) ==")
+}
+
+/// Times `samples` runs of `batch` calls to `body`, and counts the allocations
+/// they make. Batching amortizes the clock reads for operations that take only
+/// a few nanoseconds.
+@discardableResult
+func measure(
+    _ name: String,
+    samples: Int,
+    batch: Int = 1,
+    warmup: Int = 10,
+    _ body: () throws -> Void
+) rethrows -> Measurement {
+    for _ in 0..<warmup {
+        try body()
+    }
+
+    var perOperation = [Double]()
+    perOperation.reserveCapacity(samples)
+
+    AllocationCounter.start()
+    let start = now()
+    for _ in 0..<samples {
+        let sampleStart = now()
+        for _ in 0..<batch {
+            try body()
+        }
+        perOperation.append(Double(now() - sampleStart) / Double(batch))
+    }
+    let elapsed = now() - start
+    let allocations = AllocationCounter.stop()
+
+    let measurement = Measurement(
+        name: name,
+        samples: perOperation,
+        operations: samples * batch,
+        elapsed: elapsed,
+        allocations: allocations
+    )
+    measurement.report()
+    return measurement
+}
+
+/// Like `measure`, for one awaited call to `body` per sample.
+@discardableResult
+func measureAsync(
+    _ name: String,
+    samples: Int,
+    warmup: Int = 10,
+    _ body: () async throws -> Void
+) async rethrows -> Measurement {
+    for _ in 0..<warmup {
+        try await body()
+    }
+
+    var perOperation = [Double]()
+    perOperation.reserveCapacity(samples)
+
+    AllocationCounter.start()
+    let start = now()
+    for _ in 0..<samples {
+        let sampleStart = now()
+        try await body()
+        perOperation.append(Double(now() - sampleStart))
+    }
+    let elapsed = now() - start
+    let allocations = AllocationCounter.stop()
+
+    let measurement = Measurement(
+        name: name,
+        samples: perOperation,
+        operations: samples,
+        elapsed: elapsed,
+        allocations: allocations
+    )
+    measurement.report()
+    return measurement
+}
+
+/// Runs `body` on `threads` threads at once, each performing `operations`
+/// operations, and reports the combined throughput.
+@discardableResult
+func measureThroughput(
+    _ name: String,
+    threads: Int,
+    operations: Int,
+    _ body: @escaping (_ thread: Int) -> Void
+) -> Measurement {
+    let group = DispatchGroup()
+    let ready = DispatchSemaphore(value: 0)
+    let go = DispatchSemaphore(value: 0)
+
+    var workers: [Thread] = []
+    for t in 0..<threads {
+        group.enter()
+        let thread = Thread {
+            ready.signal()
+            go.wait()
+            body(t)
+            group.leave()
+        }
+        workers.append(thread)
+        thread.start()
+    }
+
+    for _ in 0..<threads {
+        ready.wait()
+    }
+    let start = now()
+    for _ in 0..<threads {
+        go.signal()
+    }
+    group.wait()
+
+    let measurement = Measurement(
+        name: name,
+        samples: [],
+        operations: threads * operations,
+        elapsed: now() - start
+    )
+    measurement.report()
+    return measurement
+}
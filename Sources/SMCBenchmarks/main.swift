@@ -0,0 +1,262 @@
+import Foundation
+import SMC
+import SMCKit
+
+// Measures the cost of each layer of the library against a live SMC:
+//
+//     swift run -c release SMCBenchmarks [samples] [--record file | --replay file]
+//
+// --record saves every call made against the SMC, and --replay answers calls
+// from such a file instead, with the recorded latencies, so runs can be
+// compared without AppleSMC. Layers that open connections of their own,
+// SMCHandle and SMCPool, are skipped when replaying.
+
+var arguments = CommandLine.arguments.dropFirst()
+var recordURL: URL?
+var replayURL: URL?
+if let flag = arguments.firstIndex(where: { $0 == "--record" || $0 == "--replay" }) {
+    guard arguments.indices.contains(flag + 1) else {
+        print("\(arguments[flag]) needs a file")
+        exit(1)
+    }
+    let url = URL(fileURLWithPath: arguments[flag + 1])
+    if arguments[flag] == "--record" { recordURL = url } else { replayURL = url }
+    arguments.removeSubrange(flag...(flag + 1))
+}
+let samples = arguments.first.flatMap(Int.init) ?? 10_000
+
+let recorder = try recordURL.map { _ in try SMCRecorder() }
+let replay = try replayURL.map { try SMCReplay(contentsOf: $0) }
+replay?.setLatency(scale: 1)
+let transport = recorder?.transport ?? replay?.transport ?? .iokit
+
+var context: OpaquePointer?
+guard SMCContextCreateWithTransport(0, transport.pointer, &context) == kIOReturnSuccess else {
+    print("Could not open a connection to the SMC")
+    exit(1)
+}
+// The C measurements go through the context, and so through the transport.
+let conn = SMCContextConnection(context)
+let smc = try SMCKit(transport: transport)
+
+let probe: FourCharCode = "#KEY"
+var probeChars = UInt32Char_t(chars: (0x23, 0x4B, 0x45, 0x59, 0))
+
+var keyCount: UInt32 = 0
+let keyCountResult = SMCContextGetKeyCount(context, &keyCount)
+guard keyCountResult.kern_res == kIOReturnSuccess,
+    keyCountResult.smc_res == UInt8(kSMCReturnSuccess)
+else {
+    print("Could not read the key count")
+    exit(1)
+}
+
+var allKeys: [FourCharCode] = []
+for index in 0..<keyCount {
+    var key = UInt32Char_t()
+    if SMCContextGetKeyFromIndex(context, index, &key).kern_res == kIOReturnSuccess {
+        allKeys.append(FourCharCode(fromCharArray: key))
+    }
+}
+print("\(allKeys.count) keys, \(samples) samples per measurement")
+
+// MARK: - Raw transport calls
+
+section("Transport call latency per command")
+
+let call = transport.pointer.pointee.call!
+let callContext = transport.pointer.pointee.context
+
+func rawCall(_ selector: Int32, configure: (inout SMCKeyData_t) -> Void) {
+    var input = SMCKeyData_t()
+    var output = SMCKeyData_t()
+    input.data8 = UInt8(selector)
+    configure(&input)
+
+    measure("selector \(selector)", samples: samples) {
+        blackHole(call(callContext, conn, SMC_KERNEL_INDEX, &input, &output))
+    }
+}
+
+rawCall(SMC_CMD_READ_KEY) { input in
+    input.key = probe
+    input.keyInfo.dataSize = 4
+}
+rawCall(SMC_CMD_READ_KEY_INFO) { input in input.key = probe }
+rawCall(SMC_CMD_GET_KEY_FROM_INDEX) { input in input.data32 = 0 }
+rawCall(SMC_CMD_READ_VERSION) { _ in }
+
+// MARK: - Key info cache
+
+section("SMCContextGetKeyInfo")
+
+var keyInfo = SMCKeyData_keyInfo_t()
+measure("hit", samples: samples, batch: 100) {
+    blackHole(SMCContextGetKeyInfo(context, probe, &keyInfo))
+}
+
+SMCContextResetCache(context)
+var missKeys = allKeys.makeIterator()
+// The warmup takes the first 10 keys.
+measure("miss (first lookup of each key)", samples: max(0, allKeys.count - 10)) {
+    if let key = missKeys.next() {
+        blackHole(SMCContextGetKeyInfo(context, key, &keyInfo))
+    }
+}
+
+var absent = false
+measure("absent key (negative hit)", samples: samples, batch: 100) {
+    blackHole(SMCContextIsKeyFound(context, "zzzz", &absent))
+}
+
+// The first flt key, for the typed read
+let floatKey = allKeys.first { key in
+    SMCContextGetKeyInfo(context, key, &keyInfo).kern_res == kIOReturnSuccess
+        && keyInfo.dataType == Float.smcDataType.type
+}
+
+section("SMCContextGetKeyInfo hit contention")
+
+SMCContextPrefetchKeyInfo(context)
+let lookupsPerThread = 1_000_000
+var threadCounts = [1]
+while threadCounts.last! * 2 <= ProcessInfo.processInfo.activeProcessorCount {
+    threadCounts.append(threadCounts.last! * 2)
+}
+for threads in threadCounts {
+    let keys = allKeys
+    measureThroughput("\(threads) threads", threads: threads, operations: lookupsPerThread) {
+        thread in
+        var info = SMCKeyData_keyInfo_t()
+        for i in 0..<lookupsPerThread {
+            blackHole(
+                SMCContextGetKeyInfo(context, keys[(i &+ thread &* 7919) % keys.count], &info))
+        }
+    }
+}
+
+// MARK: - Reads through each layer
+
+section("Reading #KEY")
+
+var val = SMCVal_t()
+measure("C SMCContextReadKey", samples: samples) {
+    blackHole(SMCContextReadKey(context, &probeChars, &val))
+}
+
+var handle = SMCKeyHandle_t()
+SMCContextResolveKey(context, &probeChars, &handle)
+measure("C SMCContextReadKeyResolved", samples: samples) {
+    blackHole(SMCContextReadKeyResolved(context, &handle, &val))
+}
+
+let batchKeys = Array(repeating: probeChars, count: 64)
+var batchVals = [SMCVal_t](repeating: SMCVal_t(), count: batchKeys.count)
+var batchResults = [SMCResult_t](repeating: SMCResult_t(), count: batchKeys.count)
+measure("C SMCContextReadKeys, batch of 64", samples: samples / 64) {
+    blackHole(SMCContextReadKeys(context, batchKeys, &batchVals, &batchResults, batchKeys.count))
+}
+
+if replay == nil {
+    let smcHandle = try SMCHandle()
+    try measure("SMCHandle.read", samples: samples) {
+        let count: BigEndian<UInt32> = try smcHandle.read(probe)
+        blackHole(count)
+    }
+
+    let resolved = try smcHandle.resolve(probe, as: BigEndian<UInt32>.self)
+    try measure("SMCHandle.read(SMCKey)", samples: samples) {
+        blackHole(try smcHandle.read(resolved))
+    }
+
+    let handleBuffer = UnsafeMutableRawBufferPointer.allocate(byteCount: 32, alignment: 1)
+    try measure("SMCHandle.readInto", samples: samples) {
+        blackHole(try smcHandle.readInto(probe, buffer: handleBuffer))
+    }
+    handleBuffer.deallocate()
+}
+
+try await measureAsync("SMCKit.read (actor)", samples: samples) {
+    let count: BigEndian<UInt32> = try await smc.read(probe)
+    blackHole(count)
+}
+
+if let floatKey {
+    try await measureAsync("SMCKit.read<Float> (actor)", samples: samples) {
+        let value: Float = try await smc.read(floatKey)
+        blackHole(value)
+    }
+}
+
+let readBuffer = UnsafeMutableRawBufferPointer.allocate(byteCount: 32, alignment: 1)
+try await measureAsync("SMCKit.readInto (actor)", samples: samples) {
+    blackHole(try await smc.readInto(probe, buffer: readBuffer))
+}
+readBuffer.deallocate()
+
+let dumpVals = UnsafeMutableBufferPointer<SMCVal_t>.allocate(capacity: allKeys.count)
+let dumpResults = UnsafeMutableBufferPointer<SMCResult_t>.allocate(capacity: allKeys.count)
+await measureAsync("SMCKit.readRaw(into:), every key", samples: max(10, samples / 1000)) {
+    blackHole(await smc.readRaw(allKeys, into: dumpVals, results: dumpResults))
+}
+await measureAsync("SMCKit.readRaw, every key", samples: max(10, samples / 1000)) {
+    blackHole(await smc.readRaw(allKeys))
+}
+dumpVals.deallocate()
+dumpResults.deallocate()
+
+if replay == nil {
+    let pool = try SMCPool(size: 4)
+    try await measureAsync("SMCPool.read", samples: samples) {
+        let count: BigEndian<UInt32> = try await pool.read(probe)
+        blackHole(count)
+    }
+}
+
+// MARK: - Decoding
+
+section("SMCCodable decode")
+
+let zero = SMCVal_t().bytes
+try measure("UInt8", samples: samples, batch: 1000) { blackHole(try UInt8(zero)) }
+try measure("UInt16", samples: samples, batch: 1000) { blackHole(try UInt16(zero)) }
+try measure("UInt32", samples: samples, batch: 1000) { blackHole(try UInt32(zero)) }
+try measure("UInt64", samples: samples, batch: 1000) { blackHole(try UInt64(zero)) }
+try measure("Int8", samples: samples, batch: 1000) { blackHole(try Int8(zero)) }
+try measure("Int16", samples: samples, batch: 1000) { blackHole(try Int16(zero)) }
+try measure("Int32", samples: samples, batch: 1000) { blackHole(try Int32(zero)) }
+try measure("Int64", samples: samples, batch: 1000) { blackHole(try Int64(zero)) }
+try measure("Float", samples: samples, batch: 1000) { blackHole(try Float(zero)) }
+try measure("Bool", samples: samples, batch: 1000) { blackHole(try Bool(zero)) }
+try measure("BigEndian<UInt32>", samples: samples, batch: 1000) {
+    blackHole(try BigEndian<UInt32>(zero))
+}
+try measure("SP78", samples: samples, batch: 1000) { blackHole(try SP78(zero)) }
+try measure("FPE2", samples: samples, batch: 1000) { blackHole(try FPE2(zero)) }
+try measure("IOFT", samples: samples, batch: 1000) { blackHole(try IOFT(zero)) }
+
+// A mixed batch the size of a typical sampler tick
+let batchTypes = (0..<128).map { i in
+    [Float.smcDataType, SP78.smcDataType, UInt16.smcDataType, FPE2.smcDataType][i % 4]
+}
+let decoder = SMCFloatDecoder(types: batchTypes)
+let decodeVals = batchTypes.map { type in
+    var val = SMCVal_t()
+    val.dataSize = type.size
+    return val
+}
+let decoded = UnsafeMutableBufferPointer<Float>.allocate(capacity: batchTypes.count)
+measure("SMCFloatDecoder, batch of 128", samples: samples, batch: 100) {
+    decodeVals.withUnsafeBufferPointer { decoder.decode($0, into: decoded) }
+    blackHole(decoded[0])
+}
+decoded.deallocate()
+
+if let recorder, let recordURL {
+    try recorder.save(to: recordURL)
+    print("\nRecorded \(recorder.count) calls to \(recordURL.path)")
+}
+if let replay, replay.misses > 0 {
+    print("\n\(replay.misses) calls had no recorded response")
+}
+SMCContextDestroy(context)
@@ -0,0 +1,314 @@
+import Accelerate
+import Foundation
+
+/// Summary statistics of the readings in a time window.
+public struct SMCWindowStatistics: Equatable, Sendable {
+    public let count: Int
+    public let min: Float
+    public let max: Float
+    public let mean: Float
+    /// The exponentially weighted moving average, for statistics kept by an
+    /// `SMCRollingWindow`. `nil` for statistics computed over a series.
+    public let ewma: Float?
+}
+
+// MARK: - Batch Kernels
+
+extension SMCTimeSeries where Value == Float {
+    /// The position of the first entry at or after `timestamp`, assuming
+    /// entries were appended in timestamp order.
+    public func firstIndex(since timestamp: UInt64) -> Int {
+        withTimestamps { older, newer in
+            if let first = newer.first, first < timestamp {
+                return older.count + lowerBound(newer, timestamp)
+            }
+            return lowerBound(older, timestamp)
+        }
+    }
+
+    /// Min, max and mean of the entries at or after `timestamp`, computed with
+    /// vDSP over the buffer in place. `nil` if the window is empty.
+    public func statistics(since timestamp: UInt64) -> SMCWindowStatistics? {
+        let start = firstIndex(since: timestamp)
+        guard start < count else { return nil }
+
+        return withWindow(from: start) { segments in
+            var low = Float.infinity
+            var high = -Float.infinity
+            var sum: Float = 0
+
+            for segment in segments where !segment.isEmpty {
+                let base = segment.baseAddress!
+                let n = vDSP_Length(segment.count)
+                var value: Float = 0
+
+                vDSP_minv(base, 1, &value, n)
+                low = Swift.min(low, value)
+                vDSP_maxv(base, 1, &value, n)
+                high = Swift.max(high, value)
+                vDSP_sve(base, 1, &value, n)
+                sum += value
+            }
+
+            let n = count - start
+            return SMCWindowStatistics(
+                count: n, min: low, max: high, mean: sum / Float(n), ewma: nil)
+        }
+    }
+
+    /// The `q` quantile (`0...1`, e.g. `0.95`) of the entries at or after
+    /// `timestamp` by nearest rank, or `nil` if the window is empty. Sorts a
+    /// copy of the window, so it costs O(n log n) per call.
+    public func quantile(_ q: Double, since timestamp: UInt64) -> Float? {
+        let start = firstIndex(since: timestamp)
+        guard start < count else { return nil }
+
+        var window: [Float] = []
+        window.reserveCapacity(count - start)
+        withWindow(from: start) { segments in
+            for segment in segments {
+                window.append(contentsOf: segment)
+            }
+        }
+        return nearestRank(&window, q)
+    }
+
+    /// Calls `body` with the value column from `start` to the newest entry,
+    /// as up to two contiguous segments.
+    private func withWindow<R>(
+        from start: Int, _ body: ([UnsafeBufferPointer<Float>]) throws -> R
+    ) rethrows -> R {
+        try withValues { older, newer in
+            if start >= older.count {
+                return try body([UnsafeBufferPointer(rebasing: newer[(start - older.count)...])])
+            }
+            return try body([UnsafeBufferPointer(rebasing: older[start...]), newer])
+        }
+    }
+
+    private func lowerBound(_ column: UnsafeBufferPointer<UInt64>, _ timestamp: UInt64) -> Int {
+        var lo = 0
+        var hi = column.count
+        while lo < hi {
+            let mid = lo + (hi - lo) / 2
+            if column[mid] < timestamp {
+                lo = mid + 1
+            } else {
+                hi = mid
+            }
+        }
+        return lo
+    }
+}
+
+/// Sorts `values` in place with vDSP and returns the `q` quantile by nearest
+/// rank.
+private func nearestRank(_ values: inout [Float], _ q: Double) -> Float? {
+    precondition(q >= 0 && q <= 1, "quantile must be within 0...1")
+    guard !values.isEmpty else { return nil }
+
+    values.withUnsafeMutableBufferPointer { buffer in
+        vDSP_vsort(buffer.baseAddress!, vDSP_Length(buffer.count), 1)
+    }
+    let rank = Int((q * Double(values.count)).rounded(.up))
+    return values[Swift.max(rank, 1) - 1]
+}
+
+// MARK: - Incremental State
+
+/// Statistics over the readings of the last `window` seconds, kept up to date
+/// as readings arrive so each one costs O(1) amortized work instead of a pass
+/// over the window.
+///
+/// The sum is kept as a running total, and min and max as monotonic queues of
+/// the readings that can still become the extreme once older ones expire. The
+/// window ends at the newest reading. NaN readings are skipped.
+///
+/// Not thread-safe; `SMCHistory` keeps one per key under its lock when created
+/// with a rolling window.
+public final class SMCRollingWindow {
+    public let window: TimeInterval
+    public let capacity: Int
+    /// The weight of each new reading in the EWMA.
+    public let ewmaAlpha: Float
+
+    private let windowNanoseconds: UInt64
+    private let timestamps: UnsafeMutablePointer<UInt64>
+    private let values: UnsafeMutablePointer<Float>
+    /// Physical index and sequence number of the oldest reading.
+    private var first = 0
+    private var firstSequence = 0
+    public private(set) var count = 0
+
+    private var sum: Double = 0
+    private var ewma: Float?
+    private var minQueue: SequenceQueue
+    private var maxQueue: SequenceQueue
+
+    /// - parameter window: The length of the window in seconds
+    /// - parameter capacity: The most readings the window holds; past that
+    ///   the oldest are dropped early
+    /// - parameter ewmaAlpha: The weight of each new reading in the EWMA,
+    ///   within `0...1`
+    public init(window: TimeInterval, capacity: Int, ewmaAlpha: Float = 0.1) {
+        precondition(window > 0, "SMCRollingWindow window must be positive")
+        precondition(capacity > 0, "SMCRollingWindow capacity must be positive")
+        precondition(ewmaAlpha >= 0 && ewmaAlpha <= 1, "ewmaAlpha must be within 0...1")
+
+        self.window = window
+        self.capacity = capacity
+        self.ewmaAlpha = ewmaAlpha
+        self.windowNanoseconds = UInt64(window * 1e9)
+        self.timestamps = .allocate(capacity: capacity)
+        self.values = .allocate(capacity: capacity)
+        self.minQueue = SequenceQueue(capacity: capacity)
+        self.maxQueue = SequenceQueue(capacity: capacity)
+    }
+
+    deinit {
+        timestamps.deallocate()
+        values.deallocate()
+        minQueue.deallocate()
+        maxQueue.deallocate()
+    }
+
+    public func append(_ value: Float, at timestamp: UInt64) {
+        guard !value.isNaN else { return }
+
+        let cutoff = timestamp >= windowNanoseconds ? timestamp - windowNanoseconds : 0
+        while count > 0 && (count == capacity || timestamps[first] < cutoff) {
+            removeOldest()
+        }
+
+        let sequence = firstSequence + count
+        let i = physicalIndex(sequence)
+        timestamps[i] = timestamp
+        values[i] = value
+        count += 1
+        sum += Double(value)
+
+        while let back = minQueue.back, values[physicalIndex(back)] >= value {
+            minQueue.popBack()
+        }
+        minQueue.pushBack(sequence)
+        while let back = maxQueue.back, values[physicalIndex(back)] <= value {
+            maxQueue.popBack()
+        }
+        maxQueue.pushBack(sequence)
+
+        ewma = ewma.map { ewmaAlpha * value + (1 - ewmaAlpha) * $0 } ?? value
+    }
+
+    /// The statistics of the readings in the window, or `nil` if it is empty.
+    public var statistics: SMCWindowStatistics? {
+        guard count > 0, let low = minQueue.front, let high = maxQueue.front else { return nil }
+
+        return SMCWindowStatistics(
+            count: count,
+            min: values[physicalIndex(low)],
+            max: values[physicalIndex(high)],
+            mean: Float(sum / Double(count)),
+            ewma: ewma
+        )
+    }
+
+    /// The `q` quantile of the readings in the window by nearest rank. Sorts a
+    /// copy of the window with vDSP, so unlike `statistics` it costs
+    /// O(n log n).
+    public func quantile(_ q: Double) -> Float? {
+        var window: [Float] = []
+        window.reserveCapacity(count)
+
+        let end = first + count
+        let older = Swift.min(end, capacity) - first
+        window.append(contentsOf: UnsafeBufferPointer(start: values + first, count: older))
+        if end > capacity {
+            window.append(contentsOf: UnsafeBufferPointer(start: values, count: end - capacity))
+        }
+        return nearestRank(&window, q)
+    }
+
+    public func removeAll() {
+        first = 0
+        firstSequence = 0
+        count = 0
+        sum = 0
+        ewma = nil
+        minQueue.removeAll()
+        maxQueue.removeAll()
+    }
+
+    private func removeOldest() {
+        sum -= Double(values[first])
+        if minQueue.front == firstSequence {
+            minQueue.popFront()
+        }
+        if maxQueue.front == firstSequence {
+            maxQueue.popFront()
+        }
+
+        first = first + 1 == capacity ? 0 : first + 1
+        firstSequence += 1
+        count -= 1
+
+        // The running total can drift after many additions and removals, so
+        // restart it from an empty window.
+        if count == 0 {
+            sum = 0
+        }
+    }
+
+    private func physicalIndex(_ sequence: Int) -> Int {
+        let i = first + (sequence - firstSequence)
+        return i < capacity ? i : i - capacity
+    }
+}
+
+/// A fixed-capacity double-ended queue of reading sequence numbers.
+private struct SequenceQueue {
+    private let storage: UnsafeMutablePointer<Int>
+    private let capacity: Int
+    private var head = 0
+    private var count = 0
+
+    init(capacity: Int) {
+        self.storage = .allocate(capacity: capacity)
+        self.capacity = capacity
+    }
+
+    func deallocate() {
+        storage.deallocate()
+    }
+
+    var front: Int? {
+        count > 0 ? storage[head] : nil
+    }
+
+    var back: Int? {
+        count > 0 ? storage[index(count - 1)] : nil
+    }
+
+    mutating func pushBack(_ sequence: Int) {
+        storage[index(count)] = sequence
+        count += 1
+    }
+
+    mutating func popBack() {
+        count -= 1
+    }
+
+    mutating func popFront() {
+        head = index(1)
+        count -= 1
+    }
+
+    mutating func removeAll() {
+        head = 0
+        count = 0
+    }
+
+    private func index(_ offset: Int) -> Int {
+        let i = head + offset
+        return i < capacity ? i : i - capacity
+    }
+}
@@ -0,0 +1,179 @@
+import Foundation
+import SMC
+
+/// Publishes the latest readings of SMC keys into shared memory, so other
+/// processes on the host can read them through `SMCBrokerClient` without an
+/// SMC connection of their own.
+///
+/// ```swift
+/// // In the process that owns the SMC connection:
+/// let broker = try SMCBroker()
+/// broker.publish(["TC0P", "F0Ac"], every: 0.5, using: SMCSampler())
+///
+/// // In any other process:
+/// let client = try SMCBrokerClient()
+/// let temp: Float = try client.read("TC0P")
+/// ```
+///
+/// Only one broker can publish under a name at a time; creating one replaces
+/// any table left behind by a previous publisher. Publishing stops, and the
+/// table is retired, when the broker is released.
+public final class SMCBroker: @unchecked Sendable {
+    public static let defaultName = "/smckit.telemetry"
+
+    private let broker: OpaquePointer
+    private let lock = NSLock()
+    private var tasks: [Task<Void, Never>] = []
+
+    /// - parameter name: The POSIX shared memory name to publish under, at most
+    ///   31 characters starting with `/`
+    /// - parameter capacity: The most keys the table holds, at most 65536
+    public init(name: String = SMCBroker.defaultName, capacity: Int = 256) throws {
+        precondition(capacity > 0, "SMCBroker capacity must be positive")
+
+        var created: OpaquePointer?
+        let result = SMCBrokerCreate(name, UInt32(clamping: capacity), &created)
+
+        guard result == kIOReturnSuccess, let created else {
+            throw SMCError.connectionFailed(kIOReturn: result)
+        }
+        self.broker = created
+    }
+
+    deinit {
+        for task in tasks {
+            task.cancel()
+        }
+        SMCBrokerClose(broker)
+    }
+
+    /// Samples `keys` through `sampler` every `interval` seconds and publishes
+    /// every reading until the broker is released.
+    public func publish(
+        _ keys: [FourCharCode], every interval: TimeInterval, using sampler: SMCSampler
+    ) {
+        let started = keys.map { key in
+            Task { [weak self] in
+                for await sample in await sampler.subscribeRaw(key, every: interval) {
+                    guard let self else { return }
+                    try? self.publish(sample)
+                }
+            }
+        }
+
+        lock.lock()
+        tasks += started
+        lock.unlock()
+    }
+
+    /// Publishes a single reading, for callers that sample keys themselves.
+    public func publish(_ sample: SMCSample<SMCVal_t>) throws {
+        var val = SMCVal_t()
+        var result = SMCResult_t(kern_res: kIOReturnSuccess, smc_res: UInt8(kSMCReturnSuccess))
+
+        switch sample.value {
+        case .success(let read):
+            val = read
+        case .failure(let error):
+            val.key = sample.key.toCharArray()
+            result = SMCResult_t(error)
+        }
+
+        let status = SMCBrokerPublish(broker, &val, result, sample.timestamp)
+        guard status == kIOReturnSuccess else {
+            throw SMCError.unknown(
+                key: sample.key.toString(), kIOReturn: status,
+                SMCResult: UInt8(kSMCReturnError))
+        }
+    }
+
+    /// The number of keys published so far.
+    public var count: Int {
+        Int(SMCBrokerCount(broker))
+    }
+}
+
+/// Reads the values an `SMCBroker` in another process publishes. Reads are
+/// lock-free loads from shared memory and never touch IOKit, so a client can
+/// be used from any thread.
+public final class SMCBrokerClient: @unchecked Sendable {
+    private let broker: OpaquePointer
+
+    /// Fails with `SMCError.connectionFailed` if nothing is published under
+    /// `name`.
+    public init(name: String = SMCBroker.defaultName) throws {
+        var opened: OpaquePointer?
+        let result = SMCBrokerOpen(name, &opened)
+
+        guard result == kIOReturnSuccess, let opened else {
+            throw SMCError.connectionFailed(kIOReturn: result)
+        }
+        self.broker = opened
+    }
+
+    deinit {
+        SMCBrokerClose(broker)
+    }
+
+    /// Whether the publisher has gone away. A retired table no longer updates;
+    /// open a new client to pick up the next publisher.
+    public var isRetired: Bool {
+        SMCBrokerRetired(broker)
+    }
+
+    /// The latest published value of `key`. Throws `SMCError.keyNotFound` if
+    /// the broker doesn't publish the key, or the error its last read hit.
+    public func read<V: SMCCodable>(_ key: FourCharCode) throws -> V {
+        try sample(key, as: V.self).value.get()
+    }
+
+    /// The latest published reading of `key`, with the time it was taken, so
+    /// callers can tell how fresh it is.
+    public func sample<V: SMCCodable>(_ key: FourCharCode, as type: V.Type = V.self) throws
+        -> SMCSample<V>
+    {
+        let raw = try rawSample(key)
+        return SMCSample(
+            key: key, timestamp: raw.timestamp,
+            value: raw.value.flatMap { val in Result { try V(val.bytes) } })
+    }
+
+    /// Like `sample(_:as:)`, but returns the undecoded value.
+    public func rawSample(_ key: FourCharCode) throws -> SMCSample<SMCVal_t> {
+        var keyCharArray = key.toCharArray()
+        var val = SMCVal_t()
+        var timestamp: UInt64 = 0
+
+        let result = SMCBrokerRead(broker, &keyCharArray, &val, &timestamp)
+
+        // Only published reads carry a timestamp, which tells a key the broker
+        // doesn't publish apart from one whose read found no such key.
+        if result.kern_res == kIOReturnSuccess, result.smc_res == UInt8(kSMCReturnKeyNotFound),
+            timestamp == 0
+        {
+            throw SMCError.keyNotFound(key: key.toString())
+        }
+        if let error = SMCError(key: key.toString(), result: result) {
+            return SMCSample(key: key, timestamp: timestamp, value: .failure(error))
+        }
+        return SMCSample(key: key, timestamp: timestamp, value: .success(val))
+    }
+}
+
+extension SMCResult_t {
+    /// The SMC status that produced `error`, for republishing a failed read.
+    init(_ error: Error) {
+        switch error {
+        case SMCError.keyNotFound:
+            self.init(kern_res: kIOReturnSuccess, smc_res: UInt8(kSMCReturnKeyNotFound))
+        case SMCError.notPrivileged:
+            self.init(kern_res: kIOReturnNotPrivileged, smc_res: UInt8(kSMCReturnError))
+        case SMCError.dataTypeMismatch:
+            self.init(kern_res: kIOReturnBadArgument, smc_res: UInt8(kSMCReturnDataTypeMismatch))
+        case SMCError.unknown(_, let kIOReturn, let SMCResult):
+            self.init(kern_res: kIOReturn, smc_res: SMCResult)
+        default:
+            self.init(kern_res: kIOReturnError, smc_res: UInt8(kSMCReturnError))
+        }
+    }
+}
@@ -0,0 +1,101 @@
+import Foundation
+import SMC
+
+/// The type and size of every SMC key, read once and then queried in memory.
+///
+/// Entries are kept in two flat arrays, one sorted by key and one by type, so
+/// prefix and type queries are a pair of binary searches that return a slice
+/// of one of them. Nothing is read from the SMC after the catalog is built.
+///
+/// ```swift
+/// let catalog = try await SMCKit.shared.catalog()
+/// for entry in catalog.entries(withPrefix: "T") where entry.dataType.type == "flt " {
+///     print(entry.key.toString())
+/// }
+/// ```
+public final class SMCKeyCatalog: @unchecked Sendable {
+    public struct Entry {
+        public let key: FourCharCode
+        public let dataType: DataType
+    }
+
+    /// A contiguous range of the catalog's entries.
+    public struct Entries: RandomAccessCollection {
+        // Keeps the catalog, and so the memory under base, alive.
+        private let owner: SMCKeyCatalog
+        private let base: UnsafePointer<SMCCatalogEntry_t>?
+
+        public let startIndex: Int
+        public let endIndex: Int
+
+        fileprivate init(
+            _ owner: SMCKeyCatalog, _ base: UnsafePointer<SMCCatalogEntry_t>?,
+            _ range: Range<Int>
+        ) {
+            self.owner = owner
+            self.base = base
+            self.startIndex = range.lowerBound
+            self.endIndex = range.upperBound
+        }
+
+        public subscript(position: Int) -> Entry {
+            precondition(position >= startIndex && position < endIndex, "Index out of range")
+            return Entry(base![position])
+        }
+
+        /// The keys of the entries, in order.
+        public var keys: [FourCharCode] {
+            map(\.key)
+        }
+    }
+
+    private let catalog: OpaquePointer
+
+    init(catalog: OpaquePointer) {
+        self.catalog = catalog
+    }
+
+    deinit {
+        SMCCatalogDestroy(catalog)
+    }
+
+    public var count: Int {
+        Int(SMCCatalogCount(catalog))
+    }
+
+    /// Every entry, sorted by key.
+    public var entries: Entries {
+        Entries(self, SMCCatalogEntries(catalog), 0..<count)
+    }
+
+    /// The entries whose keys start with `prefix`, sorted by key. The prefix is
+    /// at most four ASCII characters; an empty prefix matches every key.
+    public func entries(withPrefix prefix: String) -> Entries {
+        var first: UInt32 = 0
+        let n = SMCCatalogPrefixRange(catalog, prefix, &first)
+        return Entries(self, SMCCatalogEntries(catalog), Int(first)..<Int(first + n))
+    }
+
+    /// The entries of the given type code, such as `"flt "`, sorted by key.
+    public func entries(ofType type: FourCharCode) -> Entries {
+        var first: UInt32 = 0
+        let n = SMCCatalogTypeRange(catalog, type, &first)
+        return Entries(self, SMCCatalogEntriesByType(catalog), Int(first)..<Int(first + n))
+    }
+
+    public func contains(_ key: FourCharCode) -> Bool {
+        SMCCatalogFind(catalog, key) != nil
+    }
+
+    /// The key's type, or `nil` if the SMC didn't report the key.
+    public func dataType(of key: FourCharCode) -> DataType? {
+        SMCCatalogFind(catalog, key).map { Entry($0.pointee).dataType }
+    }
+}
+
+extension SMCKeyCatalog.Entry {
+    fileprivate init(_ entry: SMCCatalogEntry_t) {
+        self.key = entry.key
+        self.dataType = DataType(type: entry.dataType, size: entry.dataSize)
+    }
+}
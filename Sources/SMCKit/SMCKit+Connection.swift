@@ -0,0 +1,603 @@
+import Foundation
+import IOKit
+import SMC
+
+/// A single SMC connection and the operations on it. The types that own
+/// connections, such as the `SMCKit` actor, forward to it.
+struct SMCConnection {
+    /// A read's result and how long it took in nanoseconds.
+    typealias TimedRead = (value: Result<SMCVal_t, Error>, nanoseconds: UInt64)
+
+    /// Keys converted for the C library at a time by the buffer-filling
+    /// `readRaw`, in stack storage.
+    private static let readChunk = 128
+
+    let port: io_connect_t
+    /// The `SMCContext_t` whose cache key info goes through, or `nil` for the
+    /// C library's shared cache.
+    let context: OpaquePointer?
+
+    init(port: io_connect_t) {
+        self.port = port
+        self.context = nil
+    }
+
+    init(context: OpaquePointer) {
+        self.port = SMCContextConnection(context)
+        self.context = context
+    }
+
+    // The cache-backed C calls, routed through the context when there is one.
+
+    private func getKeyInfo(_ key: UInt32, _ keyInfo: inout SMCKeyData_keyInfo_t) -> SMCResult_t {
+        context.map { SMCContextGetKeyInfo($0, key, &keyInfo) } ?? SMCGetKeyInfo(key, &keyInfo, port)
+    }
+
+    private func readKey(_ key: inout UInt32Char_t, _ val: inout SMCVal_t) -> SMCResult_t {
+        context.map { SMCContextReadKey($0, &key, &val) } ?? SMCReadKey(&key, &val, port)
+    }
+
+    private func writeKey(_ val: inout SMCVal_t) -> SMCResult_t {
+        context.map { SMCContextWriteKey($0, &val) } ?? SMCWriteKey(&val, port)
+    }
+
+    func warmCache() throws {
+        let result = context.map { SMCContextPrefetchKeyInfo($0) } ?? SMCPrefetchKeyInfo(self.port)
+
+        if let error = SMCError(key: "#KEY", result: result) {
+            throw error
+        }
+    }
+
+    func freezeCache() throws {
+        let result = context.map { SMCContextFreezeKeyInfo($0) } ?? SMCFreezeKeyInfo(self.port)
+
+        if let error = SMCError(key: "#KEY", result: result) {
+            throw error
+        }
+    }
+
+    func warmCache(from url: URL) throws {
+        let result =
+            context.map { SMCContextLoadKeyInfoCache($0, url.path) }
+            ?? SMCLoadKeyInfoCache(url.path, self.port)
+
+        if let error = SMCError(key: "#KEY", result: result) {
+            throw error
+        }
+    }
+
+    func catalog() throws -> SMCKeyCatalog {
+        var created: OpaquePointer?
+        let result =
+            context.map { SMCContextCreateCatalog($0, &created) }
+            ?? SMCCatalogCreate(self.port, &created)
+
+        if let error = SMCError(key: "#KEY", result: result) {
+            throw error
+        }
+        return SMCKeyCatalog(catalog: created!)
+    }
+
+    func getKeyInformation(_ key: FourCharCode) throws -> DataType {
+        var keyInfo = SMCKeyData_keyInfo_t()
+        let result = getKeyInfo(key, &keyInfo)
+
+        switch (result.kern_res, result.smc_res) {
+        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
+            return DataType(
+                type: keyInfo.dataType,
+                size: UInt32(keyInfo.dataSize)
+            )
+        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
+            throw SMCError.keyNotFound(key: key.toString())
+        case (kIOReturnNotPrivileged, _):
+            throw SMCError.notPrivileged
+        default:
+            throw SMCError.unknown(
+                key: key.toString(),
+                kIOReturn: result.kern_res,
+                SMCResult: result.smc_res
+            )
+        }
+    }
+
+    func isKeyFound(_ key: FourCharCode) throws -> Bool {
+        var found = false
+        let result =
+            context.map { SMCContextIsKeyFound($0, key, &found) }
+            ?? SMCIsKeyFound(key, &found, self.port)
+
+        if let error = SMCError(key: key.toString(), result: result) {
+            throw error
+        }
+        return found
+    }
+
+    func read<V: SMCCodable>(_ key: FourCharCode) throws -> V {
+        var keyCharArray = key.toCharArray()
+        var smcVal = SMCVal_t()
+
+        let result = readKey(&keyCharArray, &smcVal)
+
+        switch (result.kern_res, result.smc_res) {
+        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
+            return try V(smcVal.bytes)
+        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
+            throw SMCError.keyNotFound(key: key.toString())
+        case (kIOReturnNotPrivileged, _):
+            throw SMCError.notPrivileged
+        default:
+            throw SMCError.unknown(
+                key: key.toString(),
+                kIOReturn: result.kern_res,
+                SMCResult: result.smc_res
+            )
+        }
+    }
+
+    func read<V: SMCCodable>(_ keys: [FourCharCode]) -> [Result<V, Error>] {
+        readRaw(keys).map { result in
+            result.flatMap { val in Result { try V(val.bytes) } }
+        }
+    }
+
+    func readRaw(_ keys: [FourCharCode]) -> [Result<SMCVal_t, Error>] {
+        var keyCharArrays = keys.map { $0.toCharArray() }
+        var smcVals = [SMCVal_t](repeating: SMCVal_t(), count: keys.count)
+        var results = [SMCResult_t](repeating: SMCResult_t(), count: keys.count)
+
+        if let context {
+            SMCContextReadKeys(context, &keyCharArrays, &smcVals, &results, keys.count)
+        } else {
+            SMCReadKeys(&keyCharArrays, &smcVals, &results, keys.count, self.port)
+        }
+
+        return keys.indices.map { i in
+            // Checked first so successful reads don't build the key's name.
+            guard !results[i].succeeded,
+                let error = SMCError(key: keys[i].toString(), result: results[i])
+            else {
+                return .success(smcVals[i])
+            }
+            return .failure(error)
+        }
+    }
+
+    /// Reads `keys` one at a time, timing each read, until the uptime in
+    /// nanoseconds passes `deadline`. The first key is always read; keys not
+    /// reached by the deadline are `nil`.
+    func readRawTimed(_ keys: [FourCharCode], until deadline: UInt64) -> [TimedRead?] {
+        var reads = [TimedRead?](repeating: nil, count: keys.count)
+
+        for (i, key) in keys.enumerated() {
+            let start = DispatchTime.now().uptimeNanoseconds
+            if i > 0 && start >= deadline {
+                break
+            }
+
+            var keyCharArray = key.toCharArray()
+            var smcVal = SMCVal_t()
+            let result = readKey(&keyCharArray, &smcVal)
+            let elapsed = DispatchTime.now().uptimeNanoseconds - start
+
+            if !result.succeeded, let error = SMCError(key: key.toString(), result: result) {
+                reads[i] = (.failure(error), elapsed)
+            } else {
+                reads[i] = (.success(smcVal), elapsed)
+            }
+        }
+        return reads
+    }
+
+    /// Reads `keys` into `vals` and `results`, which must hold at least
+    /// `keys.count` elements, returning how many reads succeeded. Nothing is
+    /// allocated on the heap.
+    func readRaw(
+        _ keys: [FourCharCode], into vals: UnsafeMutableBufferPointer<SMCVal_t>,
+        results: UnsafeMutableBufferPointer<SMCResult_t>
+    ) -> Int {
+        precondition(
+            vals.count >= keys.count && results.count >= keys.count,
+            "readRaw buffers must hold a value and a result for every key")
+
+        return withUnsafeTemporaryAllocation(
+            of: UInt32Char_t.self, capacity: SMCConnection.readChunk
+        ) { chunk in
+            var succeeded = 0
+            var start = 0
+            while start < keys.count {
+                let n = min(chunk.count, keys.count - start)
+                for i in 0..<n {
+                    chunk[i] = keys[start + i].toCharArray()
+                }
+
+                let chunkVals = vals.baseAddress! + start
+                let chunkResults = results.baseAddress! + start
+                if let context {
+                    SMCContextReadKeys(context, chunk.baseAddress, chunkVals, chunkResults, n)
+                } else {
+                    SMCReadKeys(chunk.baseAddress, chunkVals, chunkResults, n, self.port)
+                }
+
+                for i in 0..<n where chunkResults[i].succeeded {
+                    succeeded += 1
+                }
+                start += n
+            }
+            return succeeded
+        }
+    }
+
+    func resolve<V: SMCCodable>(_ key: FourCharCode, as type: V.Type) throws -> SMCKey<V> {
+        var keyCharArray = key.toCharArray()
+        var handle = SMCKeyHandle_t()
+
+        let result =
+            context.map { SMCContextResolveKey($0, &keyCharArray, &handle) }
+            ?? SMCResolveKey(&keyCharArray, &handle, self.port)
+
+        if let error = SMCError(key: key.toString(), result: result) {
+            throw error
+        }
+        guard handle.dataType == V.smcDataType.type, handle.dataSize == V.smcDataType.size else {
+            throw SMCError.dataTypeMismatch(key: key.toString())
+        }
+        return SMCKey(handle: handle)
+    }
+
+    func read<V: SMCCodable>(_ key: SMCKey<V>) throws -> V {
+        var handle = key.handle
+        var smcVal = SMCVal_t()
+
+        let result =
+            context.map { SMCContextReadKeyResolved($0, &handle, &smcVal) }
+            ?? SMCReadKeyResolved(&handle, &smcVal, self.port)
+
+        if let error = SMCError(key: key.code.toString(), result: result) {
+            throw error
+        }
+        return try V(smcVal.bytes)
+    }
+
+    func write<V: SMCCodable>(_ key: SMCKey<V>, _ value: V) throws {
+        var handle = key.handle
+        var smcVal = SMCVal_t()
+        smcVal.bytes = try value.encode()
+
+        let result =
+            context.map { SMCContextWriteKeyResolved($0, &handle, &smcVal) }
+            ?? SMCWriteKeyResolved(&handle, &smcVal, self.port)
+
+        if let error = SMCError(key: key.code.toString(), result: result) {
+            throw error
+        }
+    }
+
+    func write<V: SMCCodable>(_ key: FourCharCode, _ value: V) throws {
+        var buf = SMCVal_t(
+            key: key.toCharArray(),
+            dataSize: V.smcDataType.size,
+            dataType: V.smcDataType.type.toCharArray(),
+            bytes: try value.encode()
+        )
+
+        let result = writeKey(&buf)
+
+        switch (result.kern_res, result.smc_res) {
+        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
+            break
+        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
+            throw SMCError.keyNotFound(key: key.toString())
+        case (kIOReturnBadArgument, UInt8(kSMCReturnDataTypeMismatch)):
+            throw SMCError.dataTypeMismatch(key: key.toString())
+        case (kIOReturnNotPrivileged, _):
+            throw SMCError.notPrivileged
+        default:
+            throw SMCError.unknown(
+                key: key.toString(),
+                kIOReturn: result.kern_res,
+                SMCResult: result.smc_res
+            )
+        }
+    }
+
+    /// Writes several values in a single pass, returning one result per value
+    /// in the same order as `vals`.
+    func writeRaw(_ vals: [SMCVal_t]) -> [Result<Void, Error>] {
+        var results = [SMCResult_t](repeating: SMCResult_t(), count: vals.count)
+
+        if let context {
+            SMCContextWriteKeys(context, vals, &results, vals.count)
+        } else {
+            SMCWriteKeys(vals, &results, vals.count, self.port)
+        }
+
+        return vals.indices.map { i in
+            let key = FourCharCode(fromCharArray: vals[i].key)
+            if let error = SMCError(key: key.toString(), result: results[i]) {
+                return .failure(error)
+            }
+            return .success(())
+        }
+    }
+
+    func readData(_ key: FourCharCode) throws -> Data {
+        var keyCharArray = key.toCharArray()
+        var smcVal = SMCVal_t()
+
+        let result = readKey(&keyCharArray, &smcVal)
+
+        switch (result.kern_res, result.smc_res) {
+        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
+            let validSize = min(Int(smcVal.dataSize), MemoryLayout<SMCBytes_t>.size)
+            return withUnsafeBytes(of: smcVal.bytes) { buffer in
+                Data(buffer.prefix(validSize))
+            }
+        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
+            throw SMCError.keyNotFound(key: key.toString())
+        case (kIOReturnNotPrivileged, _):
+            throw SMCError.notPrivileged
+        default:
+            throw SMCError.unknown(
+                key: key.toString(),
+                kIOReturn: result.kern_res,
+                SMCResult: result.smc_res
+            )
+        }
+    }
+
+    /// Copies the bytes of `key` into `buffer`, returning how many were
+    /// copied: the value's size, or `buffer.count` if that is smaller.
+    func readInto(_ key: FourCharCode, buffer: UnsafeMutableRawBufferPointer) throws -> Int {
+        var keyCharArray = key.toCharArray()
+        var smcVal = SMCVal_t()
+
+        let result = readKey(&keyCharArray, &smcVal)
+
+        if !result.succeeded, let error = SMCError(key: key.toString(), result: result) {
+            throw error
+        }
+
+        let size = min(Int(smcVal.dataSize), MemoryLayout<SMCBytes_t>.size, buffer.count)
+        withUnsafeBytes(of: smcVal.bytes) { bytes in
+            buffer.copyMemory(from: UnsafeRawBufferPointer(rebasing: bytes.prefix(size)))
+        }
+        return size
+    }
+
+    func readString(_ key: FourCharCode) throws -> String {
+        var keyCharArray = key.toCharArray()
+        var smcVal = SMCVal_t()
+
+        let result = readKey(&keyCharArray, &smcVal)
+
+        switch (result.kern_res, result.smc_res) {
+        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
+            let validSize = min(Int(smcVal.dataSize), MemoryLayout<SMCBytes_t>.size)
+            let bytes = withUnsafeBytes(of: smcVal.bytes) { buffer in
+                Array(buffer.prefix(validSize))
+            }
+
+            let endIndex = bytes.firstIndex(of: 0) ?? bytes.count
+            let stringBytes = Array(bytes.prefix(endIndex))
+
+            guard let string = String(bytes: stringBytes, encoding: .ascii) else {
+                throw SMCError.invalidStringData(key: key.toString())
+            }
+            return string
+        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
+            throw SMCError.keyNotFound(key: key.toString())
+        case (kIOReturnNotPrivileged, _):
+            throw SMCError.notPrivileged
+        default:
+            throw SMCError.unknown(
+                key: key.toString(),
+                kIOReturn: result.kern_res,
+                SMCResult: result.smc_res
+            )
+        }
+    }
+
+    func writeData(_ key: FourCharCode, _ value: Data) throws {
+        let keyInfo = try getKeyInformation(key)
+
+        guard keyInfo.type == DataTypes.HexData.type else {
+            throw SMCError.dataTypeMismatch(key: key.toString())
+        }
+
+        guard value.count == keyInfo.size else {
+            throw SMCError.invalidDataSize(
+                key: key.toString(),
+                expected: keyInfo.size,
+                actual: UInt32(value.count)
+            )
+        }
+
+        var bytes: SMCBytes_t = (
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0
+        )
+        value.withUnsafeBytes { buffer in
+            withUnsafeMutableBytes(of: &bytes) { dest in
+                dest.copyBytes(
+                    from: buffer.prefix(min(buffer.count, MemoryLayout<SMCBytes_t>.size)))
+            }
+        }
+
+        var buf = SMCVal_t(
+            key: key.toCharArray(),
+            dataSize: keyInfo.size,
+            dataType: keyInfo.type.toCharArray(),
+            bytes: bytes
+        )
+
+        let result = writeKey(&buf)
+
+        switch (result.kern_res, result.smc_res) {
+        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
+            break
+        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
+            throw SMCError.keyNotFound(key: key.toString())
+        case (kIOReturnBadArgument, UInt8(kSMCReturnDataTypeMismatch)):
+            throw SMCError.dataTypeMismatch(key: key.toString())
+        case (kIOReturnNotPrivileged, _):
+            throw SMCError.notPrivileged
+        default:
+            throw SMCError.unknown(
+                key: key.toString(),
+                kIOReturn: result.kern_res,
+                SMCResult: result.smc_res
+            )
+        }
+    }
+
+    func writeString(_ key: FourCharCode, _ value: String) throws {
+        let keyInfo = try getKeyInformation(key)
+
+        guard keyInfo.type == DataTypes.Ch8String.type else {
+            throw SMCError.dataTypeMismatch(key: key.toString())
+        }
+
+        guard let stringBytes = value.data(using: .ascii) else {
+            throw SMCError.invalidStringData(key: key.toString())
+        }
+
+        guard stringBytes.count <= keyInfo.size else {
+            throw SMCError.invalidDataSize(
+                key: key.toString(),
+                expected: keyInfo.size,
+                actual: UInt32(stringBytes.count)
+            )
+        }
+
+        var bytes: SMCBytes_t = (
+            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 0, 0
+        )
+        stringBytes.withUnsafeBytes { buffer in
+            withUnsafeMutableBytes(of: &bytes) { dest in
+                dest.copyBytes(
+                    from: buffer.prefix(min(buffer.count, MemoryLayout<SMCBytes_t>.size)))
+            }
+        }
+
+        var buf = SMCVal_t(
+            key: key.toCharArray(),
+            dataSize: keyInfo.size,
+            dataType: keyInfo.type.toCharArray(),
+            bytes: bytes
+        )
+
+        let result = writeKey(&buf)
+
+        switch (result.kern_res, result.smc_res) {
+        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
+            break
+        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
+            throw SMCError.keyNotFound(key: key.toString())
+        case (kIOReturnBadArgument, UInt8(kSMCReturnDataTypeMismatch)):
+            throw SMCError.dataTypeMismatch(key: key.toString())
+        case (kIOReturnNotPrivileged, _):
+            throw SMCError.notPrivileged
+        default:
+            throw SMCError.unknown(
+                key: key.toString(),
+                kIOReturn: result.kern_res,
+                SMCResult: result.smc_res
+            )
+        }
+    }
+
+    /// The firmware version. With a context, only the first call reaches the
+    /// SMC.
+    func version() throws -> SMCVersion {
+        var vers = SMCKeyData_vers_t()
+        let result =
+            context.map { SMCContextReadVersion($0, &vers) } ?? SMCReadVersion(&vers, self.port)
+
+        if let error = SMCError(key: "vers", result: result) {
+            throw error
+        }
+        return SMCVersion(vers)
+    }
+
+    func powerLimits() throws -> SMCPowerLimits {
+        var limits = SMCKeyData_pLimitData_t()
+        let result =
+            context.map { SMCContextReadPowerLimits($0, &limits) }
+            ?? SMCReadPowerLimits(&limits, self.port)
+
+        if let error = SMCError(key: "plim", result: result) {
+            throw error
+        }
+        return SMCPowerLimits(limits)
+    }
+
+    func numKeys() throws -> UInt32 {
+        var count: UInt32 = 0
+        let result =
+            context.map { SMCContextGetKeyCount($0, &count) } ?? SMCGetKeyCount(&count, self.port)
+
+        if let error = SMCError(key: "#KEY", result: result) {
+            throw error
+        }
+        return count
+    }
+
+    func allKeys() throws -> [FourCharCode] {
+        try keys(in: 0..<self.numKeys())
+    }
+
+    func keys(in indices: Range<UInt32>) throws -> [FourCharCode] {
+        var keys: [FourCharCode] = []
+        keys.reserveCapacity(indices.count)
+
+        for index in indices {
+            var keyBuffer = UInt32Char_t(chars: (0, 0, 0, 0, 0))
+
+            let result =
+                context.map { SMCContextGetKeyFromIndex($0, index, &keyBuffer) }
+                ?? SMCGetKeyFromIndex(index, &keyBuffer, self.port)
+
+            switch (result.kern_res, result.smc_res) {
+            case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
+                keys.append(FourCharCode(fromCharArray: keyBuffer))
+            case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
+                throw SMCError.keyNotFound(key: "Index \(index)")
+            case (kIOReturnBadArgument, UInt8(kSMCReturnDataTypeMismatch)):
+                throw SMCError.dataTypeMismatch(key: "Index \(index)")
+            case (kIOReturnNotPrivileged, _):
+                throw SMCError.notPrivileged
+            default:
+                throw SMCError.unknown(
+                    key: "Index \(index)",
+                    kIOReturn: result.kern_res,
+                    SMCResult: result.smc_res
+                )
+            }
+        }
+
+        return keys
+    }
+}
+
+extension SMCVal_t {
+    /// Compares the first `dataSize` bytes of two values.
+    func hasSameBytes(as other: SMCVal_t) -> Bool {
+        guard dataSize == other.dataSize else { return false }
+
+        let size = Int(min(dataSize, UInt32(MemoryLayout<SMCBytes_t>.size)))
+        return withUnsafeBytes(of: bytes) { x in
+            withUnsafeBytes(of: other.bytes) { y in
+                memcmp(x.baseAddress!, y.baseAddress!, size) == 0
+            }
+        }
+    }
+}
+
+extension SMCResult_t {
+    var succeeded: Bool {
+        kern_res == kIOReturnSuccess && smc_res == UInt8(kSMCReturnSuccess)
+    }
+}
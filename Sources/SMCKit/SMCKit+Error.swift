@@ -20,3 +20,25 @@ public enum SMCError: Error {
         SMCResult: smc_return_t
     )
 }
+
+extension SMCError {
+    /// Maps the status of an SMC call to an error, or `nil` if it succeeded.
+    init?(key: String, result: SMCResult_t) {
+        switch (result.kern_res, result.smc_res) {
+        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
+            return nil
+        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
+            self = .keyNotFound(key: key)
+        case (kIOReturnBadArgument, UInt8(kSMCReturnDataTypeMismatch)):
+            self = .dataTypeMismatch(key: key)
+        case (kIOReturnNotPrivileged, _):
+            self = .notPrivileged
+        default:
+            self = .unknown(
+                key: key,
+                kIOReturn: result.kern_res,
+                SMCResult: result.smc_res
+            )
+        }
+    }
+}
@@ -0,0 +1,180 @@
+import Accelerate
+import Foundation
+import SMC
+
+/// Decodes batches of numeric readings to `Float`.
+///
+/// A decoder is built once for a fixed list of key types, such as the keys a
+/// sampler reads every tick. Decoding makes one pass that pulls each raw value
+/// out as an integer, then converts and scales the whole batch with a pair of
+/// vDSP calls. Types that don't fit in 32 bits, and `flt ` itself, are copied
+/// directly. All working memory is allocated at init, so decoding into a
+/// caller-provided buffer doesn't allocate.
+///
+/// Supported types are the 8, 16 and 32-bit integers, 64-bit integers, `flag`,
+/// `flt `, `sp78`, `fpe2` and `ioft`. Failed reads, unsupported types and
+/// values whose size doesn't match their type decode to NaN.
+///
+/// Not thread-safe; use one decoder per batch loop.
+public final class SMCFloatDecoder {
+    private enum Kind {
+        case unsupported
+        // Staged as Int32 and scaled
+        case ui8, ui16, si8, si16, si32, sp78, fpe2, flag
+        // Decoded directly
+        case float, ui32, ui64, si64, ioft
+    }
+
+    public let count: Int
+
+    private let kinds: [Kind]
+    private let sizes: [UInt32]
+    private let scales: UnsafeMutablePointer<Float>
+    private let staging: UnsafeMutablePointer<Int32>
+    /// Entries written after the vector pass: directly decoded values and
+    /// failures, with their indices.
+    private let exceptionIndices: UnsafeMutablePointer<Int>
+    private let exceptionValues: UnsafeMutablePointer<Float>
+
+    /// - parameter types: The type of each key in the batches to decode, in
+    ///   batch order.
+    public init(types: [DataType]) {
+        count = types.count
+        kinds = types.map(SMCFloatDecoder.kind(of:))
+        sizes = types.map(\.size)
+
+        let capacity = max(count, 1)
+        scales = .allocate(capacity: capacity)
+        staging = .allocate(capacity: capacity)
+        exceptionIndices = .allocate(capacity: capacity)
+        exceptionValues = .allocate(capacity: capacity)
+
+        for (i, kind) in kinds.enumerated() {
+            switch kind {
+            case .sp78: scales[i] = 1 / 256
+            case .fpe2: scales[i] = 1 / 4
+            default: scales[i] = 1
+            }
+        }
+    }
+
+    deinit {
+        scales.deallocate()
+        staging.deallocate()
+        exceptionIndices.deallocate()
+        exceptionValues.deallocate()
+    }
+
+    public func decode(_ results: [Result<SMCVal_t, Error>]) -> [Float] {
+        [Float](unsafeUninitializedCapacity: count) { buffer, initialized in
+            decode(results, into: buffer)
+            initialized = count
+        }
+    }
+
+    /// Decodes `results`, which must hold `count` entries, into the first
+    /// `count` elements of `output`.
+    public func decode(_ results: [Result<SMCVal_t, Error>], into output: UnsafeMutableBufferPointer<Float>) {
+        precondition(results.count == count && output.count >= count, "Batch size mismatch")
+
+        var exceptions = 0
+        for (i, result) in results.enumerated() {
+            switch result {
+            case .success(let val):
+                stage(val, at: i, exceptions: &exceptions)
+            case .failure:
+                stageFailure(at: i, exceptions: &exceptions)
+            }
+        }
+        finish(into: output, exceptions: exceptions)
+    }
+
+    /// Decodes `vals`, which must hold `count` successful readings, into the
+    /// first `count` elements of `output`.
+    public func decode(_ vals: UnsafeBufferPointer<SMCVal_t>, into output: UnsafeMutableBufferPointer<Float>) {
+        precondition(vals.count == count && output.count >= count, "Batch size mismatch")
+
+        var exceptions = 0
+        for i in 0..<count {
+            stage(vals[i], at: i, exceptions: &exceptions)
+        }
+        finish(into: output, exceptions: exceptions)
+    }
+
+    @inline(__always)
+    private func stage(_ val: SMCVal_t, at i: Int, exceptions: inout Int) {
+        guard val.dataSize == sizes[i] else {
+            stageFailure(at: i, exceptions: &exceptions)
+            return
+        }
+
+        let raw = val.bytes
+        switch kinds[i] {
+        case .ui8:
+            staging[i] = Int32(raw.0)
+        case .flag:
+            staging[i] = raw.0 != 0 ? 1 : 0
+        case .si8:
+            staging[i] = Int32(Int8(bitPattern: raw.0))
+        case .ui16:
+            staging[i] = Int32(UInt16(littleEndian: load(raw, as: UInt16.self)))
+        case .si16:
+            staging[i] = Int32(Int16(littleEndian: load(raw, as: Int16.self)))
+        case .si32:
+            staging[i] = Int32(littleEndian: load(raw, as: Int32.self))
+        case .sp78:
+            staging[i] = Int32(Int16(bigEndian: load(raw, as: Int16.self)))
+        case .fpe2:
+            staging[i] = Int32(UInt16(bigEndian: load(raw, as: UInt16.self)))
+        case .float:
+            stageDirect(Float(bitPattern: UInt32(littleEndian: load(raw, as: UInt32.self))), at: i, exceptions: &exceptions)
+        case .ui32:
+            stageDirect(Float(UInt32(littleEndian: load(raw, as: UInt32.self))), at: i, exceptions: &exceptions)
+        case .ui64:
+            stageDirect(Float(UInt64(littleEndian: load(raw, as: UInt64.self))), at: i, exceptions: &exceptions)
+        case .si64:
+            stageDirect(Float(Int64(littleEndian: load(raw, as: Int64.self))), at: i, exceptions: &exceptions)
+        case .ioft:
+            let fixed = UInt64(littleEndian: load(raw, as: UInt64.self))
+            stageDirect(Float(Double(fixed) / 65536), at: i, exceptions: &exceptions)
+        case .unsupported:
+            stageFailure(at: i, exceptions: &exceptions)
+        }
+    }
+
+    @inline(__always)
+    private func stageDirect(_ value: Float, at i: Int, exceptions: inout Int) {
+        staging[i] = 0
+        exceptionIndices[exceptions] = i
+        exceptionValues[exceptions] = value
+        exceptions += 1
+    }
+
+    @inline(__always)
+    private func stageFailure(at i: Int, exceptions: inout Int) {
+        stageDirect(.nan, at: i, exceptions: &exceptions)
+    }
+
+    private func finish(into output: UnsafeMutableBufferPointer<Float>, exceptions: Int) {
+        guard let out = output.baseAddress, count > 0 else { return }
+
+        let n = vDSP_Length(count)
+        vDSP_vflt32(staging, 1, out, 1, n)
+        vDSP_vmul(out, 1, scales, 1, out, 1, n)
+
+        for k in 0..<exceptions {
+            out[exceptionIndices[k]] = exceptionValues[k]
+        }
+    }
+
+    private static func kind(of type: DataType) -> Kind {
+        let kinds: [(DataType, Kind)] = [
+            (DataTypes.UInt8, .ui8), (DataTypes.UInt16, .ui16), (DataTypes.UInt32, .ui32),
+            (DataTypes.UInt64, .ui64), (DataTypes.Int8, .si8), (DataTypes.Int16, .si16),
+            (DataTypes.Int32, .si32), (DataTypes.Int64, .si64), (DataTypes.Flag, .flag),
+            (DataTypes.Float, .float), (DataTypes.SP78, .sp78), (DataTypes.FPE2, .fpe2),
+            (DataTypes.IOFT, .ioft),
+        ]
+        return kinds.first { $0.0 == type }?.1 ?? .unsupported
+    }
+}
@@ -0,0 +1,114 @@
+import Foundation
+import IOKit
+import SMC
+
+/// A synchronous SMC handle that can be used from any thread without `await`.
+///
+/// `SMCKit` serializes calls through its actor, which costs an executor hop per
+/// call. For tight control loops where that hop outweighs the IOKit call
+/// itself, use a handle instead. It relies on the C library's thread-safe key
+/// info cache and on the kernel serializing calls on a connection, so it needs
+/// no isolation of its own. Give each thread its own handle to keep threads
+/// from waiting on each other in the kernel.
+///
+/// ```swift
+/// let smc = try SMCHandle()
+/// let rpm: Float = try smc.read("F0Ac")
+/// ```
+public final class SMCHandle: @unchecked Sendable {
+    private let connection: SMCConnection
+
+    public init() throws {
+        var conn: io_connect_t = 0
+        let result = SMCOpen(&conn)
+
+        guard result == kIOReturnSuccess else {
+            throw SMCError.connectionFailed(kIOReturn: result)
+        }
+        self.connection = SMCConnection(port: conn)
+    }
+
+    deinit {
+        SMCClose(connection.port)
+    }
+
+    public func getKeyInformation(_ key: FourCharCode) throws -> DataType {
+        try connection.getKeyInformation(key)
+    }
+
+    public func isKeyFound(_ key: FourCharCode) throws -> Bool {
+        try connection.isKeyFound(key)
+    }
+
+    public func read<V: SMCCodable>(_ key: FourCharCode) throws -> V {
+        try connection.read(key)
+    }
+
+    /// Reads several keys in a single pass, returning one result per key in the
+    /// same order as `keys`.
+    public func read<V: SMCCodable>(_ keys: [FourCharCode]) -> [Result<V, Error>] {
+        connection.read(keys)
+    }
+
+    /// Like `read(_ keys:)`, but returns the undecoded values.
+    public func readRaw(_ keys: [FourCharCode]) -> [Result<SMCVal_t, Error>] {
+        connection.readRaw(keys)
+    }
+
+    /// Like `readRaw(_ keys:)`, but fills caller-owned storage instead of
+    /// returning an array: `vals[i]` and `results[i]` receive the value and
+    /// status of `keys[i]`, and the number of successful reads is returned.
+    /// Both buffers must hold at least `keys.count` elements. Nothing is
+    /// allocated per key, so one pair of buffers can be reused for every dump
+    /// of the full key set.
+    @discardableResult
+    public func readRaw(
+        _ keys: [FourCharCode], into vals: UnsafeMutableBufferPointer<SMCVal_t>,
+        results: UnsafeMutableBufferPointer<SMCResult_t>
+    ) -> Int {
+        connection.readRaw(keys, into: vals, results: results)
+    }
+
+    public func write<V: SMCCodable>(_ key: FourCharCode, _ value: V) throws {
+        try connection.write(key, value)
+    }
+
+    /// Looks up `key` once and checks it holds a `V`. Reads and writes through the
+    /// returned key skip the key info lookup.
+    public func resolve<V: SMCCodable>(_ key: FourCharCode, as type: V.Type = V.self) throws
+        -> SMCKey<V>
+    {
+        try connection.resolve(key, as: type)
+    }
+
+    public func read<V: SMCCodable>(_ key: SMCKey<V>) throws -> V {
+        try connection.read(key)
+    }
+
+    public func write<V: SMCCodable>(_ key: SMCKey<V>, _ value: V) throws {
+        try connection.write(key, value)
+    }
+
+    public func readData(_ key: FourCharCode) throws -> Data {
+        try connection.readData(key)
+    }
+
+    /// Copies the bytes of `key` into `buffer` without allocating, returning
+    /// how many were copied: the value's size, or `buffer.count` if that is
+    /// smaller. `SMCBytes_t` is 32 bytes, so a buffer that size holds any key.
+    public func readInto(_ key: FourCharCode, buffer: UnsafeMutableRawBufferPointer) throws -> Int {
+        try connection.readInto(key, buffer: buffer)
+    }
+
+    public func readString(_ key: FourCharCode) throws -> String {
+        try connection.readString(key)
+    }
+
+    public func writeData(_ key: FourCharCode, _ value: Data) throws {
+        try connection.writeData(key, value)
+    }
+
+    public func writeString(_ key: FourCharCode, _ value: String) throws {
+        try connection.writeString(key, value)
+    }
+}
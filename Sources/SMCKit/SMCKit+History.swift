@@ -0,0 +1,260 @@
+import Foundation
+import SMC
+
+/// A fixed-capacity ring buffer of timestamped values.
+///
+/// Timestamps and values are kept in two separately allocated columns set up
+/// once at init, so appending never allocates and scans over one column touch
+/// only that column's memory. Once full, each append overwrites the oldest
+/// entry. Elements are indexed from oldest (`0`) to newest (`count - 1`).
+///
+/// Not thread-safe; see `SMCHistory` for a locked, keyed store.
+public final class SMCTimeSeries<Value>: RandomAccessCollection {
+    public let capacity: Int
+    public private(set) var count = 0
+
+    /// Physical index of the next write.
+    private var head = 0
+    private let timestamps: UnsafeMutablePointer<UInt64>
+    private let values: UnsafeMutablePointer<Value>
+
+    public init(capacity: Int) {
+        precondition(capacity > 0, "SMCTimeSeries capacity must be positive")
+
+        self.capacity = capacity
+        self.timestamps = .allocate(capacity: capacity)
+        self.values = .allocate(capacity: capacity)
+    }
+
+    deinit {
+        values.deinitialize(count: count)
+        values.deallocate()
+        timestamps.deallocate()
+    }
+
+    public var startIndex: Int { 0 }
+    public var endIndex: Int { count }
+
+    public subscript(position: Int) -> (timestamp: UInt64, value: Value) {
+        precondition(position >= 0 && position < count, "Index out of range")
+
+        let i = physicalIndex(position)
+        return (timestamps[i], values[i])
+    }
+
+    /// The most recently appended entry.
+    public var latest: (timestamp: UInt64, value: Value)? {
+        isEmpty ? nil : self[count - 1]
+    }
+
+    public func append(_ value: Value, at timestamp: UInt64) {
+        timestamps[head] = timestamp
+        if count < capacity {
+            (values + head).initialize(to: value)
+            count += 1
+        } else {
+            values[head] = value
+        }
+        head = head + 1 == capacity ? 0 : head + 1
+    }
+
+    public func removeAll() {
+        values.deinitialize(count: count)
+        count = 0
+        head = 0
+    }
+
+    /// Calls `body` with the value column as two contiguous segments, older
+    /// entries first. The second segment is empty until the buffer wraps.
+    public func withValues<R>(
+        _ body: (UnsafeBufferPointer<Value>, UnsafeBufferPointer<Value>) throws -> R
+    ) rethrows -> R {
+        let (older, newer) = segments(values)
+        return try body(older, newer)
+    }
+
+    /// Calls `body` with the timestamp column as two contiguous segments, older
+    /// entries first. The second segment is empty until the buffer wraps.
+    public func withTimestamps<R>(
+        _ body: (UnsafeBufferPointer<UInt64>, UnsafeBufferPointer<UInt64>) throws -> R
+    ) rethrows -> R {
+        let (older, newer) = segments(timestamps)
+        return try body(older, newer)
+    }
+
+    private func physicalIndex(_ position: Int) -> Int {
+        let oldest = count < capacity ? 0 : head
+        let i = oldest + position
+        return i < capacity ? i : i - capacity
+    }
+
+    private func segments<T>(
+        _ column: UnsafeMutablePointer<T>
+    ) -> (UnsafeBufferPointer<T>, UnsafeBufferPointer<T>) {
+        let base = UnsafePointer(column)
+        if count < capacity {
+            return (
+                UnsafeBufferPointer(start: base, count: count),
+                UnsafeBufferPointer(start: base, count: 0)
+            )
+        }
+        return (
+            UnsafeBufferPointer(start: base + head, count: capacity - head),
+            UnsafeBufferPointer(start: base, count: head)
+        )
+    }
+}
+
+/// A thread-safe store of recent readings, one `SMCTimeSeries` per key.
+///
+/// Each key's buffer is allocated the first time the key is recorded; after
+/// that, recording a sample takes a lock and writes into preallocated storage
+/// without allocating.
+///
+/// ```swift
+/// let history = SMCHistory(capacityPerKey: 600)
+/// for await sample in await sampler.subscribe("TC0P", every: 0.1, as: Float.self) {
+///     history.record(sample)
+/// }
+/// ```
+///
+/// Created with a `rollingWindow`, the store also keeps an `SMCRollingWindow`
+/// per key, so `statistics(_:)` answers in O(1) per key however long the
+/// window is.
+public final class SMCHistory: @unchecked Sendable {
+    public let capacityPerKey: Int
+    public let rollingWindow: TimeInterval?
+    public let ewmaAlpha: Float
+
+    private let lock = NSLock()
+    private var series: [FourCharCode: SMCTimeSeries<Float>] = [:]
+    private var rolling: [FourCharCode: SMCRollingWindow] = [:]
+
+    /// - parameter capacityPerKey: The most readings kept for each key
+    /// - parameter rollingWindow: The length in seconds of the window kept
+    ///   incrementally for each key, or `nil` to keep none
+    /// - parameter ewmaAlpha: The weight of each new reading in the rolling
+    ///   window's EWMA
+    public init(capacityPerKey: Int, rollingWindow: TimeInterval? = nil, ewmaAlpha: Float = 0.1) {
+        precondition(capacityPerKey > 0, "SMCHistory capacity must be positive")
+
+        self.capacityPerKey = capacityPerKey
+        self.rollingWindow = rollingWindow
+        self.ewmaAlpha = ewmaAlpha
+    }
+
+    /// Allocates the buffer for `key` ahead of its first sample.
+    public func reserve(_ key: FourCharCode) {
+        lock.lock()
+        defer { lock.unlock() }
+
+        _ = seriesLocked(key)
+        _ = rollingLocked(key)
+    }
+
+    /// Records a successful sample. Failed samples are ignored.
+    public func record(_ sample: SMCSample<Float>) {
+        guard case .success(let value) = sample.value else { return }
+        record(sample.key, value, at: sample.timestamp)
+    }
+
+    public func record(_ key: FourCharCode, _ value: Float, at timestamp: UInt64) {
+        lock.lock()
+        defer { lock.unlock() }
+
+        seriesLocked(key).append(value, at: timestamp)
+        rollingLocked(key)?.append(value, at: timestamp)
+    }
+
+    public func latest(_ key: FourCharCode) -> (timestamp: UInt64, value: Float)? {
+        lock.lock()
+        defer { lock.unlock() }
+
+        return series[key]?.latest
+    }
+
+    /// Calls `body` with the series for `key` while holding the store's lock,
+    /// or returns `nil` if nothing has been recorded for it.
+    public func withSeries<R>(
+        _ key: FourCharCode,
+        _ body: (SMCTimeSeries<Float>) throws -> R
+    ) rethrows -> R? {
+        lock.lock()
+        defer { lock.unlock() }
+
+        guard let series = series[key] else { return nil }
+        return try body(series)
+    }
+
+    /// The rolling window statistics of each key, in the same order as `keys`,
+    /// read under a single lock acquisition. `nil` for keys with no readings,
+    /// or for every key when the store has no rolling window.
+    public func statistics(_ keys: [FourCharCode]) -> [SMCWindowStatistics?] {
+        lock.lock()
+        defer { lock.unlock() }
+
+        return keys.map { rolling[$0]?.statistics }
+    }
+
+    /// The statistics of each key's readings from the last `window` seconds,
+    /// computed with vDSP over the stored series. `nil` for keys with no
+    /// readings in the window.
+    public func statistics(
+        _ keys: [FourCharCode], over window: TimeInterval
+    ) -> [SMCWindowStatistics?] {
+        let since = cutoff(window)
+
+        lock.lock()
+        defer { lock.unlock() }
+
+        return keys.map { series[$0]?.statistics(since: since) }
+    }
+
+    /// The `q` quantile of each key's readings from the last `window` seconds.
+    public func quantile(
+        _ q: Double, of keys: [FourCharCode], over window: TimeInterval
+    ) -> [Float?] {
+        let since = cutoff(window)
+
+        lock.lock()
+        defer { lock.unlock() }
+
+        return keys.map { series[$0]?.quantile(q, since: since) }
+    }
+
+    public var keys: [FourCharCode] {
+        lock.lock()
+        defer { lock.unlock() }
+
+        return Array(series.keys)
+    }
+
+    /// The uptime `window` seconds ago, on the clock `SMCSample` timestamps use.
+    private func cutoff(_ window: TimeInterval) -> UInt64 {
+        let now = DispatchTime.now().uptimeNanoseconds
+        let length = UInt64(max(0, window) * 1e9)
+        return now > length ? now - length : 0
+    }
+
+    private func rollingLocked(_ key: FourCharCode) -> SMCRollingWindow? {
+        guard let rollingWindow else { return nil }
+        if let existing = rolling[key] {
+            return existing
+        }
+
+        let created = SMCRollingWindow(
+            window: rollingWindow, capacity: capacityPerKey, ewmaAlpha: ewmaAlpha)
+        rolling[key] = created
+        return created
+    }
+
+    private func seriesLocked(_ key: FourCharCode) -> SMCTimeSeries<Float> {
+        if let existing = series[key] {
+            return existing
+        }
+
+        let created = SMCTimeSeries<Float>(capacity: capacityPerKey)
+        series[key] = created
+        return created
+    }
+}
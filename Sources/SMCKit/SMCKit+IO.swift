@@ -0,0 +1,75 @@
+import Dispatch
+import Foundation
+
+/// Runs blocking SMC calls off the Swift concurrency thread pool, one at a
+/// time in submission order unless created concurrent.
+///
+/// `IOConnectCallStructMethod` blocks for the length of the SMC transaction.
+/// Awaiting a call here suspends the caller instead of tying up one of the
+/// pool's few cooperative threads while the SMC is busy.
+final class SMCIOQueue: @unchecked Sendable {
+    private let queue: DispatchQueue
+
+    /// - parameter concurrent: Whether calls may run side by side, for callers
+    ///   that bound how many are submitted at once, as `SMCPool` does
+    init(label: String, concurrent: Bool = false) {
+        queue = DispatchQueue(
+            label: label, qos: .userInitiated, attributes: concurrent ? .concurrent : [])
+    }
+
+    func perform<T>(_ body: @escaping () throws -> T) async throws -> T {
+        try await withCheckedThrowingContinuation { continuation in
+            queue.async {
+                continuation.resume(with: Result { try body() })
+            }
+        }
+    }
+
+    func performNonThrowing<T>(_ body: @escaping () -> T) async -> T {
+        await withCheckedContinuation { continuation in
+            queue.async {
+                continuation.resume(returning: body())
+            }
+        }
+    }
+}
+
+/// Admits a fixed number of callers at a time. Callers over the limit suspend
+/// until admitted, in arrival order, rather than blocking their thread.
+final class SMCAsyncSemaphore: @unchecked Sendable {
+    private let lock = NSLock()
+    private var available: Int
+    private var waiters: [CheckedContinuation<Void, Never>] = []
+
+    init(_ count: Int) {
+        available = count
+    }
+
+    func wait() async {
+        lock.lock()
+        if available > 0 {
+            available -= 1
+            lock.unlock()
+            return
+        }
+
+        await withCheckedContinuation { continuation in
+            waiters.append(continuation)
+            lock.unlock()
+        }
+    }
+
+    func signal() {
+        lock.lock()
+        guard !waiters.isEmpty else {
+            available += 1
+            lock.unlock()
+            return
+        }
+
+        // The admission passes straight to the waiter.
+        let waiter = waiters.removeFirst()
+        lock.unlock()
+        waiter.resume()
+    }
+}
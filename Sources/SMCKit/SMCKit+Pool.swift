@@ -0,0 +1,154 @@
+import Foundation
+import IOKit
+import SMC
+
+/// A pool of SMC connections for processes with several concurrent readers.
+///
+/// Unlike `SMCKit`, which runs every call one at a time on a single connection,
+/// each call on a pool takes whichever connection is idle, so independent
+/// callers such as a fan controller and a telemetry exporter don't queue up
+/// behind each other.
+///
+/// ```swift
+/// let pool = try SMCPool(size: 4)
+/// let temp: Float = try await pool.read("TC0P")
+/// ```
+@available(macOS 10.15, *)
+public final class SMCPool: @unchecked Sendable {
+    private let pool: OpaquePointer
+    /// Admits one caller per connection, so `SMCPoolAcquire` never has to
+    /// wait, and waiting callers suspend instead of holding a thread.
+    private let slots: SMCAsyncSemaphore
+    private let io = SMCIOQueue(label: "com.srimanachanta.SMCKit.pool", concurrent: true)
+
+    public var size: Int { SMCPoolSize(pool) }
+
+    public init(size: Int = 4) throws {
+        precondition(size > 0, "SMCPool needs at least one connection")
+
+        var created: OpaquePointer?
+        let result = SMCPoolCreate(size, &created)
+
+        guard result == kIOReturnSuccess, let created else {
+            throw SMCError.connectionFailed(kIOReturn: result)
+        }
+        self.pool = created
+        self.slots = SMCAsyncSemaphore(SMCPoolSize(created))
+    }
+
+    deinit {
+        SMCPoolDestroy(pool)
+    }
+
+    /// Runs `body` with an idle connection on the pool's I/O queue, so neither
+    /// waiting for a connection nor the SMC call blocks a concurrency thread.
+    private func withConnection<T>(_ body: @escaping (SMCConnection) throws -> T) async throws
+        -> T
+    {
+        await slots.wait()
+        defer { slots.signal() }
+
+        let pool = pool
+        return try await io.perform {
+            let port = SMCPoolAcquire(pool)
+            defer { SMCPoolRelease(pool, port) }
+
+            return try body(SMCConnection(port: port))
+        }
+    }
+
+    private func withConnectionNonThrowing<T>(_ body: @escaping (SMCConnection) -> T) async -> T {
+        await slots.wait()
+        defer { slots.signal() }
+
+        let pool = pool
+        return await io.performNonThrowing {
+            let port = SMCPoolAcquire(pool)
+            defer { SMCPoolRelease(pool, port) }
+
+            return body(SMCConnection(port: port))
+        }
+    }
+
+    public func getKeyInformation(_ key: FourCharCode) async throws -> DataType {
+        try await withConnection { try $0.getKeyInformation(key) }
+    }
+
+    public func isKeyFound(_ key: FourCharCode) async throws -> Bool {
+        try await withConnection { try $0.isKeyFound(key) }
+    }
+
+    public func read<V: SMCCodable>(_ key: FourCharCode) async throws -> V {
+        try await withConnection { try $0.read(key) }
+    }
+
+    /// Reads several keys in a single pass on one connection, returning one
+    /// result per key in the same order as `keys`.
+    public func read<V: SMCCodable>(_ keys: [FourCharCode]) async -> [Result<V, Error>] {
+        await withConnectionNonThrowing { $0.read(keys) }
+    }
+
+    /// Like `read(_ keys:)`, but returns the undecoded values.
+    public func readRaw(_ keys: [FourCharCode]) async -> [Result<SMCVal_t, Error>] {
+        await withConnectionNonThrowing { $0.readRaw(keys) }
+    }
+
+    /// Like `readRaw(_ keys:)`, but fills caller-owned storage instead of
+    /// returning an array: `vals[i]` and `results[i]` receive the value and
+    /// status of `keys[i]`, and the number of successful reads is returned.
+    /// Both buffers must hold at least `keys.count` elements. Nothing is
+    /// allocated per key, so one pair of buffers can be reused for every dump
+    /// of the full key set.
+    @discardableResult
+    public func readRaw(
+        _ keys: [FourCharCode], into vals: UnsafeMutableBufferPointer<SMCVal_t>,
+        results: UnsafeMutableBufferPointer<SMCResult_t>
+    ) async -> Int {
+        await withConnectionNonThrowing { $0.readRaw(keys, into: vals, results: results) }
+    }
+
+    public func write<V: SMCCodable>(_ key: FourCharCode, _ value: V) async throws {
+        try await withConnection { try $0.write(key, value) }
+    }
+
+    /// Looks up `key` once and checks it holds a `V`. Reads and writes through the
+    /// returned key skip the key info lookup.
+    public func resolve<V: SMCCodable>(_ key: FourCharCode, as type: V.Type = V.self) async throws
+        -> SMCKey<V>
+    {
+        try await withConnection { try $0.resolve(key, as: type) }
+    }
+
+    public func read<V: SMCCodable>(_ key: SMCKey<V>) async throws -> V {
+        try await withConnection { try $0.read(key) }
+    }
+
+    public func write<V: SMCCodable>(_ key: SMCKey<V>, _ value: V) async throws {
+        try await withConnection { try $0.write(key, value) }
+    }
+
+    public func readData(_ key: FourCharCode) async throws -> Data {
+        try await withConnection { try $0.readData(key) }
+    }
+
+    /// Copies the bytes of `key` into `buffer` without allocating, returning
+    /// how many were copied: the value's size, or `buffer.count` if that is
+    /// smaller. `SMCBytes_t` is 32 bytes, so a buffer that size holds any key.
+    public func readInto(_ key: FourCharCode, buffer: UnsafeMutableRawBufferPointer) async throws
+        -> Int
+    {
+        try await withConnection { try $0.readInto(key, buffer: buffer) }
+    }
+
+    public func readString(_ key: FourCharCode) async throws -> String {
+        try await withConnection { try $0.readString(key) }
+    }
+
+    public func writeData(_ key: FourCharCode, _ value: Data) async throws {
+        try await withConnection { try $0.writeData(key, value) }
+    }
+
+    public func writeString(_ key: FourCharCode, _ value: String) async throws {
+        try await withConnection { try $0.writeString(key, value) }
+    }
+}
@@ -0,0 +1,679 @@
+import Dispatch
+import Foundation
+import SMC
+
+/// A reading delivered by `SMCSampler`.
+public struct SMCSample<Value> {
+    public let key: FourCharCode
+    /// `DispatchTime.now().uptimeNanoseconds` when the read was issued.
+    public let timestamp: UInt64
+    public let value: Result<Value, Error>
+}
+
+/// How long reads of a key take, as timed by an `SMCSampler` that isolates
+/// slow keys.
+public struct SMCKeyLatency: Sendable {
+    /// The number of reads timed.
+    public let samples: Int
+    /// The exponentially weighted average read time in nanoseconds.
+    public let average: UInt64
+    /// The longest read in nanoseconds.
+    public let max: UInt64
+    /// Whether the key is read on the slow lane.
+    public let isSlow: Bool
+}
+
+/// Polls SMC keys on behalf of any number of subscribers.
+///
+/// Every subscription has its own interval, but they all share one timer
+/// wheel. A key is read once per due time no matter how many subscriptions
+/// want it, and all keys that fall due together are read in a single batched
+/// pass before the result is fanned out to each subscription's stream.
+///
+/// ```swift
+/// let sampler = SMCSampler()
+/// let temps = await sampler.subscribe("TC0P", every: 0.25, as: Float.self)
+/// for await sample in temps {
+///     print(try sample.value.get())
+/// }
+/// ```
+///
+/// Keys that take much longer to read than others hold up every key batched
+/// with them. Pass `SlowKeyIsolation` to time reads and move keys that are
+/// chronically slow onto a connection of their own.
+@available(macOS 10.15, *)
+public actor SMCSampler {
+    /// Moves keys that are slow to read off the sampler's connection.
+    ///
+    /// A key's first reads are timed one at a time. If its average passes
+    /// `threshold`, it is read on the slow lane from then on: a second
+    /// `SMCKit` instance with the same transport as the sampler's, so the
+    /// other keys due in the same tick don't wait for it. Keys found to be
+    /// fast are read in a single batch through the sampler's instance and its
+    /// value cache. A batch that runs past `deadline` seconds into the tick
+    /// has its keys timed one at a time again, to find the one that slowed
+    /// down.
+    ///
+    /// Keys still being timed are read cheapest first after the batch, and
+    /// any not reached by the deadline are read on the slow lane too.
+    public struct SlowKeyIsolation: Sendable {
+        /// The average read time, in seconds, past which a key is slow. It is
+        /// fast again once its average falls below half of this.
+        public let threshold: TimeInterval
+        /// How long, in seconds, the fast lane of a tick keeps reading.
+        public let deadline: TimeInterval
+
+        public init(threshold: TimeInterval = 0.002, deadline: TimeInterval = 0.005) {
+            precondition(threshold > 0, "SlowKeyIsolation threshold must be positive")
+            precondition(deadline > 0, "SlowKeyIsolation deadline must be positive")
+
+            self.threshold = threshold
+            self.deadline = deadline
+        }
+    }
+
+    private struct Subscription {
+        let key: FourCharCode
+        var intervalTicks: UInt64
+        /// The due tick of the subscription's live wheel entry. Entries left
+        /// behind when an adaptive subscription is rescheduled early don't
+        /// match it and are dropped when they come up.
+        var due: UInt64 = 0
+        let backoff: Backoff?
+        let deliver: (Result<SMCVal_t, Error>, UInt64) -> Void
+    }
+
+    /// How an adaptive subscription's interval moves between its bounds.
+    private struct Backoff {
+        let minTicks: UInt64
+        let maxTicks: UInt64
+        /// Whether a reading stayed close enough to the previous ones for the
+        /// interval to keep growing.
+        let isSteady: (Result<SMCVal_t, Error>) -> Bool
+    }
+
+    /// Read times of a key, kept while isolating slow keys.
+    private struct Profile {
+        var samples = 0
+        var average: Double = 0
+        var max: UInt64 = 0
+        var isSlow = false
+    }
+
+    /// The weight of each read in a key's average read time.
+    private static let latencyWeight = 0.2
+    /// Reads a key needs before it can be classified as slow or fast.
+    private static let minimumLatencySamples = 4
+
+    private let smc: SMCKit
+    private let resolution: UInt64
+    private let start = DispatchTime.now().uptimeNanoseconds
+    private let isolation: SlowKeyIsolation?
+
+    /// The connection slow keys are read on, opened the first time one is
+    /// found. Slow keys share the sampler's own if it can't be opened.
+    private lazy var slowLane: SMCKit = (try? SMCKit(transport: smc.transport)) ?? smc
+    private var profiles: [FourCharCode: Profile] = [:]
+    /// Keys with a slow-lane read under way. They aren't read again until it
+    /// finishes.
+    private var slowInFlight: Set<FourCharCode> = []
+
+    private var wheel = TimerWheel()
+    private var subscriptions: [Int: Subscription] = [:]
+    private var nextID = 0
+
+    private var loop: Task<Void, Never>?
+    private var wakeTick: UInt64 = .max
+
+    private var thermalState = ProcessInfo.processInfo.thermalState
+    private var thermalObserver: NSObjectProtocol?
+
+    /// - parameter smc: The SMC instance to read from
+    /// - parameter resolution: The length of a timer wheel tick in seconds.
+    ///   Intervals are rounded to a whole number of ticks.
+    /// - parameter slowKeys: Whether and how to move slow keys onto their own
+    ///   connection, or `nil` to read every key due in a tick in one batch
+    public init(
+        smc: SMCKit = .shared, resolution: TimeInterval = 0.01,
+        isolating slowKeys: SlowKeyIsolation? = nil
+    ) {
+        precondition(resolution > 0, "SMCSampler resolution must be positive")
+
+        self.smc = smc
+        self.resolution = UInt64(resolution * 1e9)
+        self.isolation = slowKeys
+    }
+
+    /// The read times of every key sampled so far. Only tracked while
+    /// isolating slow keys, and only for reads timed one key at a time.
+    public var keyLatencies: [FourCharCode: SMCKeyLatency] {
+        profiles.mapValues { profile in
+            SMCKeyLatency(
+                samples: profile.samples, average: UInt64(profile.average),
+                max: profile.max, isSlow: profile.isSlow)
+        }
+    }
+
+    deinit {
+        if let thermalObserver {
+            NotificationCenter.default.removeObserver(thermalObserver)
+        }
+    }
+
+    /// Starts sampling `key` every `interval` seconds. The first sample is taken
+    /// right away. Sampling stops once the returned stream is no longer consumed.
+    public func subscribe<V: SMCCodable>(
+        _ key: FourCharCode,
+        every interval: TimeInterval,
+        as type: V.Type = V.self
+    ) -> AsyncStream<SMCSample<V>> {
+        addSubscription(key, every: interval, bufferingPolicy: .bufferingNewest(32)) { raw in
+            raw.flatMap { val in Result { try V(val.bytes) } }
+        }
+    }
+
+    /// Like `subscribe(_:every:as:)`, but yields the undecoded values.
+    public func subscribeRaw(
+        _ key: FourCharCode,
+        every interval: TimeInterval
+    ) -> AsyncStream<SMCSample<SMCVal_t>> {
+        addSubscription(key, every: interval, bufferingPolicy: .bufferingNewest(32)) { $0 }
+    }
+
+    /// Like `subscribe(_:every:as:)`, but only yields a sample when the key's
+    /// raw bytes differ from the last sample yielded, so unchanged values are
+    /// never decoded or delivered. A failing key is reported once, when it
+    /// starts failing.
+    ///
+    /// Only the newest sample is buffered: a consumer that falls behind gets
+    /// the latest value rather than every change in between.
+    public func subscribeChanges<V: SMCCodable>(
+        _ key: FourCharCode,
+        every interval: TimeInterval,
+        as type: V.Type = V.self
+    ) -> AsyncStream<SMCSample<V>> {
+        var last: Result<SMCVal_t, Error>?
+
+        return addSubscription(key, every: interval, bufferingPolicy: .bufferingNewest(1)) { raw in
+            switch (raw, last) {
+            case (.success(let new), .success(let old)?) where new.hasSameBytes(as: old):
+                return nil
+            case (.failure, .failure?):
+                return nil
+            default:
+                last = raw
+                return raw.flatMap { val in Result { try V(val.bytes) } }
+            }
+        }
+    }
+
+    /// Like `subscribeChanges(_:every:as:)` for a `Float` key, but a new value
+    /// is only yielded once it moves more than `deadband` away from the last
+    /// value yielded. Comparing against the last yielded value rather than the
+    /// previous sample means slow drift is still reported.
+    public func subscribeChanges(
+        _ key: FourCharCode,
+        every interval: TimeInterval,
+        deadband: Float
+    ) -> AsyncStream<SMCSample<Float>> {
+        precondition(deadband >= 0, "SMCSampler deadband must not be negative")
+
+        var last: Result<Float, Error>?
+
+        return addSubscription(key, every: interval, bufferingPolicy: .bufferingNewest(1)) { raw in
+            let value = raw.flatMap { val in Result { try Float(val.bytes) } }
+
+            switch (value, last) {
+            case (.success(let new), .success(let old)?)
+            where new.isNaN == old.isNaN && !(abs(new - old) > deadband):
+                return nil
+            case (.failure, .failure?):
+                return nil
+            default:
+                last = value
+                return value
+            }
+        }
+    }
+
+    /// Samples `key` at an interval that adapts to how much it changes. The
+    /// interval starts at `interval.lowerBound` and doubles after every sample
+    /// whose raw bytes match the previous one, up to `interval.upperBound`.
+    /// A changed value snaps it back to the lower bound, as does a rise in the
+    /// system's thermal state, which also takes a sample right away. The
+    /// interval doesn't grow while the thermal state is above nominal.
+    ///
+    /// Every sample taken is yielded.
+    public func subscribeAdaptive<V: SMCCodable>(
+        _ key: FourCharCode,
+        interval: ClosedRange<TimeInterval>,
+        as type: V.Type = V.self
+    ) -> AsyncStream<SMCSample<V>> {
+        var last: Result<SMCVal_t, Error>?
+
+        let backoff = makeBackoff(interval) { raw in
+            defer { last = raw }
+
+            switch (raw, last) {
+            case (.success(let new), .success(let old)?):
+                return new.hasSameBytes(as: old)
+            case (.failure, .failure?):
+                return true
+            default:
+                return false
+            }
+        }
+        return addSubscription(
+            key, every: interval.lowerBound, backoff: backoff,
+            bufferingPolicy: .bufferingNewest(32)
+        ) { raw in
+            raw.flatMap { val in Result { try V(val.bytes) } }
+        }
+    }
+
+    /// Like `subscribeAdaptive(_:interval:as:)` for a `Float` key, but the
+    /// interval keeps growing while the value stays within `deadband` of the
+    /// value where it last reset, so noise and slow drift below the deadband
+    /// don't hold the key at its fastest rate.
+    public func subscribeAdaptive(
+        _ key: FourCharCode,
+        interval: ClosedRange<TimeInterval>,
+        deadband: Float
+    ) -> AsyncStream<SMCSample<Float>> {
+        precondition(deadband >= 0, "SMCSampler deadband must not be negative")
+
+        var reference: Float?
+        var failing = false
+
+        let backoff = makeBackoff(interval) { raw in
+            guard let new = try? Float(raw.get().bytes), !new.isNaN else {
+                // A key that keeps failing is as flat as one that holds still.
+                defer { failing = true }
+                reference = nil
+                return failing
+            }
+            failing = false
+
+            if let old = reference, abs(new - old) <= deadband {
+                return true
+            }
+            reference = new
+            return false
+        }
+        return addSubscription(
+            key, every: interval.lowerBound, backoff: backoff,
+            bufferingPolicy: .bufferingNewest(32)
+        ) { raw in
+            raw.flatMap { val in Result { try Float(val.bytes) } }
+        }
+    }
+
+    private func makeBackoff(
+        _ interval: ClosedRange<TimeInterval>,
+        isSteady: @escaping (Result<SMCVal_t, Error>) -> Bool
+    ) -> Backoff {
+        precondition(interval.lowerBound > 0, "SMCSampler intervals must be positive")
+
+        observeThermalState()
+        return Backoff(
+            minTicks: ticks(for: interval.lowerBound),
+            maxTicks: ticks(for: interval.upperBound),
+            isSteady: isSteady
+        )
+    }
+
+    /// Registers a subscription whose samples are produced by `transform`,
+    /// which may return `nil` to skip a sample. `transform` runs on the actor.
+    private func addSubscription<V>(
+        _ key: FourCharCode,
+        every interval: TimeInterval,
+        backoff: Backoff? = nil,
+        bufferingPolicy: AsyncStream<SMCSample<V>>.Continuation.BufferingPolicy,
+        transform: @escaping (Result<SMCVal_t, Error>) -> Result<V, Error>?
+    ) -> AsyncStream<SMCSample<V>> {
+        var streamContinuation: AsyncStream<SMCSample<V>>.Continuation?
+        let stream = AsyncStream(SMCSample<V>.self, bufferingPolicy: bufferingPolicy) {
+            streamContinuation = $0
+        }
+        let continuation = streamContinuation!
+
+        let id = nextID
+        nextID += 1
+
+        subscriptions[id] = Subscription(
+            key: key, intervalTicks: ticks(for: interval), backoff: backoff
+        ) { raw, timestamp in
+            guard let value = transform(raw) else { return }
+            continuation.yield(SMCSample(key: key, timestamp: timestamp, value: value))
+        }
+        continuation.onTermination = { [weak self] _ in
+            Task { await self?.unsubscribe(id) }
+        }
+
+        schedule(id, at: currentTick())
+        return stream
+    }
+
+    private func unsubscribe(_ id: Int) {
+        subscriptions[id] = nil
+
+        if subscriptions.isEmpty {
+            loop?.cancel()
+            loop = nil
+            wakeTick = .max
+            wheel = TimerWheel()
+        }
+    }
+
+    private func ticks(for interval: TimeInterval) -> UInt64 {
+        max(1, UInt64((interval * 1e9 / Double(resolution)).rounded()))
+    }
+
+    private func currentTick() -> UInt64 {
+        (DispatchTime.now().uptimeNanoseconds - start) / resolution
+    }
+
+    private func schedule(_ id: Int, at tick: UInt64) {
+        subscriptions[id]?.due = wheel.schedule(id, at: tick)
+
+        // Wake the loop early if it's sleeping past the new due time.
+        if loop == nil || tick < wakeTick {
+            loop?.cancel()
+            loop = Task { await self.run() }
+        }
+    }
+
+    private func run() async {
+        while !Task.isCancelled {
+            guard let next = wheel.nextDue else {
+                loop = nil
+                wakeTick = .max
+                return
+            }
+
+            wakeTick = next
+            let deadline = start + next * resolution
+            let now = DispatchTime.now().uptimeNanoseconds
+            if deadline > now {
+                try? await Task.sleep(nanoseconds: deadline - now)
+            }
+            if Task.isCancelled {
+                return
+            }
+
+            wakeTick = .max
+            await poll(wheel.advance(to: currentTick()))
+        }
+    }
+
+    private func poll(_ due: [TimerWheel.Entry]) async {
+        var keys: [FourCharCode] = []
+        var seen: Set<FourCharCode> = []
+
+        for entry in due {
+            guard let subscription = subscriptions[entry.id] else { continue }
+            if seen.insert(subscription.key).inserted {
+                keys.append(subscription.key)
+            }
+        }
+        guard !keys.isEmpty else { return }
+
+        let timestamp = DispatchTime.now().uptimeNanoseconds
+        guard let isolation else {
+            let results = await smc.readRaw(keys)
+            complete(due, with: Dictionary(uniqueKeysWithValues: zip(keys, results)), at: timestamp)
+            return
+        }
+
+        var batched: [FourCharCode] = []
+        var timed: [FourCharCode] = []
+        var slow: [FourCharCode] = []
+        for key in keys where !slowInFlight.contains(key) {
+            let profile = profiles[key] ?? Profile()
+            if profile.isSlow {
+                slow.append(key)
+            } else if profile.samples >= SMCSampler.minimumLatencySamples {
+                batched.append(key)
+            } else {
+                timed.append(key)
+            }
+        }
+        // Cheapest first, so the deadline only cuts off the stragglers.
+        timed.sort { (profiles[$0]?.average ?? 0) < (profiles[$1]?.average ?? 0) }
+
+        let deadline = timestamp + UInt64(isolation.deadline * 1e9)
+        var results: [FourCharCode: Result<SMCVal_t, Error>] = [:]
+        if !batched.isEmpty {
+            let reads = await smc.readRaw(batched)
+            results = Dictionary(uniqueKeysWithValues: zip(batched, reads))
+
+            if DispatchTime.now().uptimeNanoseconds > deadline {
+                for key in batched {
+                    profiles[key]?.samples = 0
+                }
+            }
+        }
+        if !timed.isEmpty {
+            let reads = await smc.readRawTimed(timed, until: deadline)
+
+            for (key, read) in zip(timed, reads) {
+                if let read {
+                    record(key, read.nanoseconds)
+                    results[key] = read.value
+                } else {
+                    slow.append(key)
+                }
+            }
+        }
+
+        let waiting = complete(due, with: results, at: timestamp, leaving: Set(slow))
+        if !slow.isEmpty {
+            readSlowLane(slow, for: waiting)
+        }
+    }
+
+    /// Delivers the reading of each entry's key and schedules the entry's next
+    /// sample. Entries whose key has no reading are rescheduled without one,
+    /// except those in `pending`, which are returned untouched.
+    @discardableResult
+    private func complete(
+        _ entries: [TimerWheel.Entry], with results: [FourCharCode: Result<SMCVal_t, Error>],
+        at timestamp: UInt64, leaving pending: Set<FourCharCode> = []
+    ) -> [TimerWheel.Entry] {
+        let tick = currentTick()
+        var left: [TimerWheel.Entry] = []
+
+        for entry in entries {
+            // Subscriptions may have gone away or been rescheduled while the
+            // read was in flight.
+            guard var subscription = subscriptions[entry.id], subscription.due == entry.due
+            else { continue }
+
+            if pending.contains(subscription.key) {
+                left.append(entry)
+                continue
+            }
+
+            let result = results[subscription.key]
+            if let result {
+                subscription.deliver(result, timestamp)
+            }
+
+            var next: UInt64
+            if let backoff = subscription.backoff {
+                if let result {
+                    if backoff.isSteady(result) && thermalState == .nominal {
+                        subscription.intervalTicks = min(
+                            backoff.maxTicks, subscription.intervalTicks * 2)
+                    } else {
+                        subscription.intervalTicks = backoff.minTicks
+                    }
+                }
+                next = tick + subscription.intervalTicks
+            } else {
+                // Stay on the original cadence, skipping any due times already
+                // missed rather than sampling in a burst to catch up.
+                next = entry.due + subscription.intervalTicks
+                if next <= tick {
+                    next +=
+                        ((tick - next) / subscription.intervalTicks + 1) * subscription.intervalTicks
+                }
+            }
+
+            subscription.due = wheel.schedule(entry.id, at: next)
+            subscriptions[entry.id] = subscription
+        }
+        return left
+    }
+
+    /// Reads `keys` on the slow lane and completes `entries` with them once
+    /// done, while later ticks go on without them.
+    private func readSlowLane(_ keys: [FourCharCode], for entries: [TimerWheel.Entry]) {
+        slowInFlight.formUnion(keys)
+
+        let lane = slowLane
+        Task {
+            let timestamp = DispatchTime.now().uptimeNanoseconds
+            let reads = await lane.readRawTimed(keys, until: .max)
+            await self.finishSlowLane(keys, reads, entries, at: timestamp)
+        }
+    }
+
+    private func finishSlowLane(
+        _ keys: [FourCharCode], _ reads: [SMCConnection.TimedRead?],
+        _ entries: [TimerWheel.Entry], at timestamp: UInt64
+    ) {
+        slowInFlight.subtract(keys)
+
+        var results: [FourCharCode: Result<SMCVal_t, Error>] = [:]
+        for (key, read) in zip(keys, reads) {
+            if let read {
+                record(key, read.nanoseconds)
+                results[key] = read.value
+            }
+        }
+        complete(entries, with: results, at: timestamp)
+
+        // Wake the loop if it's asleep past the rescheduled due times. While it
+        // polls, wakeTick is .max and it checks the wheel again afterwards.
+        if let next = wheel.nextDue, loop == nil || (wakeTick != .max && next < wakeTick) {
+            loop?.cancel()
+            loop = Task { await self.run() }
+        }
+    }
+
+    /// Adds a read to the key's profile and moves it between lanes when its
+    /// average crosses the threshold.
+    private func record(_ key: FourCharCode, _ nanoseconds: UInt64) {
+        guard let isolation else { return }
+
+        var profile = profiles[key] ?? Profile()
+        profile.samples += 1
+        profile.max = max(profile.max, nanoseconds)
+        if profile.samples == 1 {
+            profile.average = Double(nanoseconds)
+        } else {
+            profile.average += SMCSampler.latencyWeight * (Double(nanoseconds) - profile.average)
+        }
+
+        let threshold = isolation.threshold * 1e9
+        if profile.samples >= SMCSampler.minimumLatencySamples {
+            if profile.average > threshold {
+                profile.isSlow = true
+            } else if profile.average < threshold / 2 {
+                profile.isSlow = false
+            }
+        }
+        profiles[key] = profile
+    }
+
+    private func observeThermalState() {
+        guard thermalObserver == nil else { return }
+
+        thermalObserver = NotificationCenter.default.addObserver(
+            forName: ProcessInfo.thermalStateDidChangeNotification, object: nil, queue: nil
+        ) { [weak self] _ in
+            Task { await self?.thermalStateChanged() }
+        }
+        thermalState = ProcessInfo.processInfo.thermalState
+    }
+
+    /// Drops every adaptive subscription to its shortest interval and samples
+    /// it right away when the thermal state rises.
+    private func thermalStateChanged() {
+        let previous = thermalState
+        thermalState = ProcessInfo.processInfo.thermalState
+        guard thermalState.rawValue > previous.rawValue else { return }
+
+        let now = currentTick()
+        for (id, subscription) in subscriptions {
+            guard let backoff = subscription.backoff else { continue }
+
+            subscriptions[id]?.intervalTicks = backoff.minTicks
+            schedule(id, at: now)
+        }
+    }
+}
+
+/// A hashed timer wheel of subscription IDs. Entries due more than one
+/// revolution ahead share a slot with nearer ones and are skipped until their
+/// tick comes around.
+struct TimerWheel {
+    struct Entry {
+        let id: Int
+        let due: UInt64
+    }
+
+    private var slots: [[Entry]]
+    private var tick: UInt64 = 0
+    private var count = 0
+
+    init(slotCount: Int = 256) {
+        slots = Array(repeating: [], count: slotCount)
+    }
+
+    /// Schedules an entry and returns the tick it is due at. Ticks that have
+    /// already been advanced past are due on the next advance.
+    @discardableResult
+    mutating func schedule(_ id: Int, at due: UInt64) -> UInt64 {
+        let due = max(due, tick)
+        slots[Int(due % UInt64(slots.count))].append(Entry(id: id, due: due))
+        count += 1
+        return due
+    }
+
+    /// Removes and returns every entry due at or before `now`.
+    mutating func advance(to now: UInt64) -> [Entry] {
+        guard now >= tick else { return [] }
+
+        var due: [Entry] = []
+        let span = min(now - tick + 1, UInt64(slots.count))
+        for t in tick..<(tick + span) {
+            let slot = Int(t % UInt64(slots.count))
+            guard !slots[slot].isEmpty else { continue }
+
+            slots[slot].removeAll { entry in
+                guard entry.due <= now else { return false }
+                due.append(entry)
+                return true
+            }
+        }
+
+        count -= due.count
+        tick = now + 1
+        return due
+    }
+
+    /// The earliest tick with an entry due, or `nil` if the wheel is empty.
+    var nextDue: UInt64? {
+        guard count > 0 else { return nil }
+
+        let revolution = UInt64(slots.count)
+        for t in tick..<(tick + revolution) {
+            if slots[Int(t % revolution)].contains(where: { $0.due == t }) {
+                return t
+            }
+        }
+        return slots.joined().map(\.due).min()
+    }
+}
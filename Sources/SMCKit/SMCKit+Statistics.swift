@@ -0,0 +1,102 @@
+import Foundation
+import SMC
+
+/// A snapshot of the C library's instrumentation counters.
+///
+/// Counting is off by default; turn it on with `SMCStatistics.isEnabled`.
+/// Counters are process-wide and cover every connection, pool and handle.
+public struct SMCStatistics: Sendable {
+    public struct Command: Sendable {
+        public let calls: UInt64
+        /// `latencyHistogram[b]` counts calls that took `[2^b, 2^(b+1))` ns.
+        public let latencyHistogram: [UInt64]
+
+        /// The upper bound of the histogram bucket holding the given quantile,
+        /// in nanoseconds.
+        public func latency(quantile: Double) -> UInt64? {
+            guard calls > 0 else { return nil }
+
+            let target = UInt64((Double(calls) * quantile).rounded(.up))
+            var seen: UInt64 = 0
+            for (bucket, count) in latencyHistogram.enumerated() {
+                seen += count
+                if seen >= max(target, 1) {
+                    return 1 << (bucket + 1)
+                }
+            }
+            return 1 << latencyHistogram.count
+        }
+    }
+
+    /// Keyed by SMC command (`SMC_CMD_*`); commands never issued are absent.
+    public let commands: [UInt8: Command]
+
+    public let cacheHits: UInt64
+    /// Hits on keys cached as missing.
+    public let cacheAbsentHits: UInt64
+    public let cacheMisses: UInt64
+    public let cacheInserts: UInt64
+    /// Keys dropped from bounded caches to make room.
+    public let cacheEvictions: UInt64
+
+    /// Failed commands by SMC status, for commands the kernel completed.
+    public let smcErrors: [UInt8: UInt64]
+    /// Failed commands by IOKit status.
+    public let kernelErrors: [kern_return_t: UInt64]
+
+    public static var isEnabled: Bool {
+        get { SMCStatsEnabled() }
+        set { SMCSetStatsEnabled(newValue) }
+    }
+
+    /// Emits an os_signpost interval around every SMC command, for profiling
+    /// in Instruments.
+    public static func setSignpostsEnabled(_ enabled: Bool) {
+        SMCSetSignpostsEnabled(enabled)
+    }
+
+    public static func reset() {
+        SMCResetStats()
+    }
+
+    public static var current: SMCStatistics {
+        var stats = SMCStats_t()
+        SMCGetStats(&stats)
+        return SMCStatistics(stats)
+    }
+
+    init(_ stats: SMCStats_t) {
+        let calls = withUnsafeBytes(of: stats.calls) { Array($0.bindMemory(to: UInt64.self)) }
+        let latency = withUnsafeBytes(of: stats.latency) { Array($0.bindMemory(to: UInt64.self)) }
+        let buckets = Int(SMC_STATS_LATENCY_BUCKETS)
+
+        var commands: [UInt8: Command] = [:]
+        for (command, count) in calls.enumerated() where count > 0 {
+            let histogram = latency[(command * buckets)..<((command + 1) * buckets)]
+            commands[UInt8(command)] = Command(calls: count, latencyHistogram: Array(histogram))
+        }
+        self.commands = commands
+
+        cacheHits = stats.cacheHits
+        cacheAbsentHits = stats.cacheAbsentHits
+        cacheMisses = stats.cacheMisses
+        cacheInserts = stats.cacheInserts
+        cacheEvictions = stats.cacheEvictions
+
+        var smcErrors: [UInt8: UInt64] = [:]
+        withUnsafeBytes(of: stats.smcErrors) { raw in
+            for (status, count) in raw.bindMemory(to: UInt64.self).enumerated() where count > 0 {
+                smcErrors[UInt8(status)] = count
+            }
+        }
+        self.smcErrors = smcErrors
+
+        var kernelErrors: [kern_return_t: UInt64] = [:]
+        withUnsafeBytes(of: stats.kernErrors) { raw in
+            for entry in raw.bindMemory(to: SMCKernErrorCount_t.self).prefix(Int(stats.kernErrorCount)) {
+                kernelErrors[entry.code] = entry.count
+            }
+        }
+        self.kernelErrors = kernelErrors
+    }
+}
@@ -0,0 +1,114 @@
+import Foundation
+import SMC
+
+/// The function table an `SMCKit` instance sends its SMC commands through.
+///
+/// Instances use `iokit`, the AppleSMC user client, unless created with
+/// another transport: an `SMCRecorder` to capture a workload, or an
+/// `SMCReplay` to run one again without AppleSMC, for example to benchmark the
+/// caching and batching layers on a machine without an SMC.
+///
+/// ```swift
+/// let recorder = try SMCRecorder()
+/// let smc = try SMCKit(transport: recorder.transport)
+/// // ... run the workload against smc ...
+/// try recorder.save(to: URL(fileURLWithPath: "workload.smcr"))
+///
+/// let replay = try SMCReplay(contentsOf: URL(fileURLWithPath: "workload.smcr"))
+/// replay.setLatency(scale: 1)
+/// let replayed = try SMCKit(transport: replay.transport)
+/// ```
+public struct SMCTransport: @unchecked Sendable {
+    public static let iokit = SMCTransport(SMCIOKitTransport(), owner: nil)
+
+    /// The table itself, for `SMCContextCreateWithTransport`. It stays valid
+    /// for as long as this value is kept.
+    public let pointer: UnsafePointer<SMCTransport_t>
+    /// Keeps the recorder or replay behind pointer alive.
+    let owner: AnyObject?
+
+    init(_ pointer: UnsafePointer<SMCTransport_t>, owner: AnyObject?) {
+        self.pointer = pointer
+        self.owner = owner
+    }
+}
+
+/// Passes calls on to another transport and records each one with its
+/// response and latency, to be saved for `SMCReplay`.
+public final class SMCRecorder: @unchecked Sendable {
+    private let recorder: OpaquePointer
+    private let inner: SMCTransport
+
+    /// - parameter inner: The transport whose calls are recorded
+    public init(recording inner: SMCTransport = .iokit) throws {
+        var created: OpaquePointer?
+        let result = SMCRecorderCreate(inner.pointer, &created)
+
+        guard result == kIOReturnSuccess, let created else {
+            throw SMCError.connectionFailed(kIOReturn: result)
+        }
+        self.recorder = created
+        self.inner = inner
+    }
+
+    deinit {
+        SMCRecorderDestroy(recorder)
+    }
+
+    public var transport: SMCTransport {
+        SMCTransport(SMCRecorderTransport(recorder), owner: self)
+    }
+
+    /// The number of calls recorded so far.
+    public var count: Int {
+        SMCRecorderCount(recorder)
+    }
+
+    /// Writes the calls recorded so far to `url`, replacing it atomically.
+    public func save(to url: URL) throws {
+        let result = SMCRecorderSave(recorder, url.path)
+        guard result == kIOReturnSuccess else {
+            throw SMCError.connectionFailed(kIOReturn: result)
+        }
+    }
+}
+
+/// Answers calls from a recording made by `SMCRecorder`, without AppleSMC.
+///
+/// Each call gets the next recorded response to the same command and key,
+/// starting over once they run out, so a replay returns the same values in
+/// the same order every run. Calls that were never recorded fail as if the
+/// key didn't exist and are counted in `misses`.
+public final class SMCReplay: @unchecked Sendable {
+    private let replay: OpaquePointer
+
+    public init(contentsOf url: URL) throws {
+        var opened: OpaquePointer?
+        let result = SMCReplayOpen(url.path, &opened)
+
+        guard result == kIOReturnSuccess, let opened else {
+            throw SMCError.connectionFailed(kIOReturn: result)
+        }
+        self.replay = opened
+    }
+
+    deinit {
+        SMCReplayClose(replay)
+    }
+
+    public var transport: SMCTransport {
+        SMCTransport(SMCReplayTransport(replay), owner: self)
+    }
+
+    /// Makes each replayed call take `scale` times its recorded latency plus
+    /// `extra` seconds. Calls return immediately until this is set.
+    public func setLatency(scale: Double = 1, extra: TimeInterval = 0) {
+        precondition(scale >= 0 && extra >= 0, "replay latency must not be negative")
+        SMCReplaySetLatency(replay, scale, UInt64(extra * 1e9))
+    }
+
+    /// The number of calls that had no recorded response.
+    public var misses: UInt64 {
+        SMCReplayMisses(replay)
+    }
+}
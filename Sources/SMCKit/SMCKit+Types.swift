@@ -107,6 +107,19 @@ enum DataTypes {
         size: 4
     )
 
+    static let SP78 = DataType(
+        type: FourCharCode(fromStaticString: "sp78"),
+        size: 2
+    )
+    static let FPE2 = DataType(
+        type: FourCharCode(fromStaticString: "fpe2"),
+        size: 2
+    )
+    static let IOFT = DataType(
+        type: FourCharCode(fromStaticString: "ioft"),
+        size: 8
+    )
+
     static let HexData = DataType(
         type: FourCharCode(fromStaticString: "hex_"),
         size: 0
@@ -123,19 +136,20 @@ public protocol SMCCodable {
     func encode() throws -> SMCBytes_t
 }
 
-@inlinable func smcBytes(_ slice: [UInt8]) -> SMCBytes_t {
-    var tmp = [UInt8](repeating: 0, count: 32)
-    tmp.replaceSubrange(0..<min(slice.count, 32), with: slice)
-    return tmp.withUnsafeBytes {
-        $0.load(as: SMCBytes_t.self)
-    }
+/// Returns zeroed SMC bytes with `value`'s in-memory representation stored at the
+/// start. Works on the tuple in place, so no intermediate array is allocated.
+@inlinable func smcBytes<T>(storing value: T) -> SMCBytes_t {
+    var bytes: SMCBytes_t = (
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0
+    )
+    withUnsafeMutableBytes(of: &bytes) { $0.storeBytes(of: value, as: T.self) }
+    return bytes
 }
 
-@inlinable func toBytes<T>(_ v: T) -> [UInt8] {
-    withUnsafeBytes(of: v) { Array($0) }
-}
-@inlinable func fromBytes<T>(_ b: [UInt8]) -> T {
-    b.withUnsafeBytes { $0.load(as: T.self) }
+/// Reinterprets the first bytes of `raw` as a `T`.
+@inlinable func load<T>(_ raw: SMCBytes_t, as type: T.Type) -> T {
+    withUnsafeBytes(of: raw) { $0.loadUnaligned(as: T.self) }
 }
 
 extension UInt8: SMCCodable {
@@ -146,7 +160,7 @@ extension UInt8: SMCCodable {
     }
 
     public func encode() throws -> SMCBytes_t {
-        smcBytes([self])
+        smcBytes(storing: self)
     }
 }
 
@@ -154,11 +168,11 @@ extension UInt16: SMCCodable {
     public static var smcDataType: DataType { DataTypes.UInt16 }
 
     public init(_ raw: SMCBytes_t) throws {
-        self = UInt16(raw.0) | (UInt16(raw.1) << 8)
+        self = UInt16(littleEndian: load(raw, as: UInt16.self))
     }
 
     public func encode() throws -> SMCBytes_t {
-        smcBytes([UInt8(self & 0xFF), UInt8(self >> 8)])
+        smcBytes(storing: littleEndian)
     }
 }
 
@@ -166,18 +180,11 @@ extension UInt32: SMCCodable {
     public static var smcDataType: DataType { DataTypes.UInt32 }
 
     public init(_ raw: SMCBytes_t) throws {
-        self =
-            UInt32(raw.0) | (UInt32(raw.1) << 8)
-            | (UInt32(raw.2) << 16) | (UInt32(raw.3) << 24)
+        self = UInt32(littleEndian: load(raw, as: UInt32.self))
     }
 
     public func encode() throws -> SMCBytes_t {
-        smcBytes([
-            UInt8(self & 0xFF),
-            UInt8((self >> 8) & 0xFF),
-            UInt8((self >> 16) & 0xFF),
-            UInt8((self >> 24) & 0xFF),
-        ])
+        smcBytes(storing: littleEndian)
     }
 }
 
@@ -189,7 +196,7 @@ extension Int8: SMCCodable {
     }
 
     public func encode() throws -> SMCBytes_t {
-        smcBytes([UInt8(bitPattern: self)])
+        smcBytes(storing: self)
     }
 }
 
@@ -197,13 +204,11 @@ extension Int16: SMCCodable {
     public static var smcDataType: DataType { DataTypes.Int16 }
 
     public init(_ raw: SMCBytes_t) throws {
-        let unsigned = UInt16(raw.0) | (UInt16(raw.1) << 8)
-        self = Int16(bitPattern: unsigned)
+        self = Int16(littleEndian: load(raw, as: Int16.self))
     }
 
     public func encode() throws -> SMCBytes_t {
-        let u = UInt16(bitPattern: self)
-        return smcBytes([UInt8(u & 0xFF), UInt8(u >> 8)])
+        smcBytes(storing: littleEndian)
     }
 }
 
@@ -211,20 +216,11 @@ extension Int32: SMCCodable {
     public static var smcDataType: DataType { DataTypes.Int32 }
 
     public init(_ raw: SMCBytes_t) throws {
-        let u =
-            UInt32(raw.0) | (UInt32(raw.1) << 8) | (UInt32(raw.2) << 16)
-            | (UInt32(raw.3) << 24)
-        self = Int32(bitPattern: u)
+        self = Int32(littleEndian: load(raw, as: Int32.self))
     }
 
     public func encode() throws -> SMCBytes_t {
-        let u = UInt32(bitPattern: self)
-        return smcBytes([
-            UInt8(u & 0xFF),
-            UInt8((u >> 8) & 0xFF),
-            UInt8((u >> 16) & 0xFF),
-            UInt8((u >> 24) & 0xFF),
-        ])
+        smcBytes(storing: littleEndian)
     }
 }
 
@@ -232,24 +228,11 @@ extension UInt64: SMCCodable {
     public static var smcDataType: DataType { DataTypes.UInt64 }
 
     public init(_ raw: SMCBytes_t) throws {
-        self =
-            UInt64(raw.0) | (UInt64(raw.1) << 8)
-            | (UInt64(raw.2) << 16) | (UInt64(raw.3) << 24)
-            | (UInt64(raw.4) << 32) | (UInt64(raw.5) << 40)
-            | (UInt64(raw.6) << 48) | (UInt64(raw.7) << 56)
+        self = UInt64(littleEndian: load(raw, as: UInt64.self))
     }
 
     public func encode() throws -> SMCBytes_t {
-        smcBytes([
-            UInt8(self & 0xFF),
-            UInt8((self >> 8) & 0xFF),
-            UInt8((self >> 16) & 0xFF),
-            UInt8((self >> 24) & 0xFF),
-            UInt8((self >> 32) & 0xFF),
-            UInt8((self >> 40) & 0xFF),
-            UInt8((self >> 48) & 0xFF),
-            UInt8((self >> 56) & 0xFF),
-        ])
+        smcBytes(storing: littleEndian)
     }
 }
 
@@ -257,26 +240,11 @@ extension Int64: SMCCodable {
     public static var smcDataType: DataType { DataTypes.Int64 }
 
     public init(_ raw: SMCBytes_t) throws {
-        let u =
-            UInt64(raw.0) | (UInt64(raw.1) << 8)
-            | (UInt64(raw.2) << 16) | (UInt64(raw.3) << 24)
-            | (UInt64(raw.4) << 32) | (UInt64(raw.5) << 40)
-            | (UInt64(raw.6) << 48) | (UInt64(raw.7) << 56)
-        self = Int64(bitPattern: u)
+        self = Int64(littleEndian: load(raw, as: Int64.self))
     }
 
     public func encode() throws -> SMCBytes_t {
-        let u = UInt64(bitPattern: self)
-        return smcBytes([
-            UInt8(u & 0xFF),
-            UInt8((u >> 8) & 0xFF),
-            UInt8((u >> 16) & 0xFF),
-            UInt8((u >> 24) & 0xFF),
-            UInt8((u >> 32) & 0xFF),
-            UInt8((u >> 40) & 0xFF),
-            UInt8((u >> 48) & 0xFF),
-            UInt8((u >> 56) & 0xFF),
-        ])
+        smcBytes(storing: littleEndian)
     }
 }
 
@@ -284,12 +252,11 @@ extension Float: SMCCodable {
     public static var smcDataType: DataType { DataTypes.Float }
 
     public init(_ raw: SMCBytes_t) throws {
-        let bytes = [raw.0, raw.1, raw.2, raw.3]
-        self = fromBytes(bytes)
+        self = Float(bitPattern: UInt32(littleEndian: load(raw, as: UInt32.self)))
     }
 
     public func encode() throws -> SMCBytes_t {
-        smcBytes(toBytes(self))
+        smcBytes(storing: bitPattern.littleEndian)
     }
 }
 
@@ -301,7 +268,7 @@ extension Bool: SMCCodable {
     }
 
     public func encode() throws -> SMCBytes_t {
-        smcBytes([self ? 1 : 0])
+        smcBytes(storing: UInt8(self ? 1 : 0))
     }
 }
 
@@ -327,24 +294,148 @@ public struct BigEndian<Value: FixedWidthInteger & SMCCodable>: SMCCodable {
     public static var smcDataType: DataType { Value.smcDataType }
 
     public init(_ raw: SMCBytes_t) throws {
-        // Read bytes in big-endian order (most significant byte first)
-        var result: Value = 0
-        withUnsafeBytes(of: raw) { buffer in
-            let size = MemoryLayout<Value>.size
-            for i in 0..<size {
-                result |= Value(buffer[i]) << ((size - 1 - i) * 8)
-            }
-        }
-        self.value = result
+        self.value = Value(bigEndian: load(raw, as: Value.self))
     }
 
     public func encode() throws -> SMCBytes_t {
-        // Write bytes in big-endian order (most significant byte first)
-        let size = MemoryLayout<Value>.size
-        var bytes = [UInt8](repeating: 0, count: size)
-        for i in 0..<size {
-            bytes[i] = UInt8((value >> ((size - 1 - i) * 8)) & 0xFF)
-        }
-        return smcBytes(bytes)
+        smcBytes(storing: value.bigEndian)
+    }
+}
+
+// MARK: - Fixed-Point Types
+
+/// Converts `value * scale` to the nearest `T`, saturating at `T`'s bounds.
+/// NaN converts to zero.
+@inlinable func fixedPoint<T: FixedWidthInteger>(_ value: Double, scale: Double, as type: T.Type) -> T {
+    let scaled = (value * scale).rounded()
+    if scaled.isNaN {
+        return 0
+    }
+    if scaled >= Double(T.max) {
+        return .max
+    }
+    if scaled <= Double(T.min) {
+        return .min
+    }
+    return T(scaled)
+}
+
+/// Signed fixed point with 7 integer and 8 fraction bits (`sp78`), stored
+/// big-endian. Used for temperatures on Intel Macs.
+public struct SP78: SMCCodable, Equatable {
+    public let value: Float
+
+    /// Values outside the representable range of about ±128 saturate.
+    public init(_ value: Float) {
+        self.value = value
+    }
+
+    public static var smcDataType: DataType { DataTypes.SP78 }
+
+    public init(_ raw: SMCBytes_t) throws {
+        self.value = Float(Int16(bigEndian: load(raw, as: Int16.self))) / 256
+    }
+
+    public func encode() throws -> SMCBytes_t {
+        smcBytes(storing: fixedPoint(Double(value), scale: 256, as: Int16.self).bigEndian)
+    }
+}
+
+/// Unsigned fixed point with 14 integer and 2 fraction bits (`fpe2`), stored
+/// big-endian. Used for fan speeds on Intel Macs.
+public struct FPE2: SMCCodable, Equatable {
+    public let value: Float
+
+    /// Values outside the representable range of 0 to about 16384 saturate.
+    public init(_ value: Float) {
+        self.value = value
+    }
+
+    public static var smcDataType: DataType { DataTypes.FPE2 }
+
+    public init(_ raw: SMCBytes_t) throws {
+        self.value = Float(UInt16(bigEndian: load(raw, as: UInt16.self))) / 4
+    }
+
+    public func encode() throws -> SMCBytes_t {
+        smcBytes(storing: fixedPoint(Double(value), scale: 4, as: UInt16.self).bigEndian)
+    }
+}
+
+/// Unsigned fixed point with 48 integer and 16 fraction bits (`ioft`), stored
+/// little-endian. Found on Apple Silicon.
+public struct IOFT: SMCCodable, Equatable {
+    public let value: Double
+
+    /// Negative values saturate to zero.
+    public init(_ value: Double) {
+        self.value = value
+    }
+
+    public static var smcDataType: DataType { DataTypes.IOFT }
+
+    public init(_ raw: SMCBytes_t) throws {
+        self.value = Double(UInt64(littleEndian: load(raw, as: UInt64.self))) / 65536
+    }
+
+    public func encode() throws -> SMCBytes_t {
+        smcBytes(storing: fixedPoint(value, scale: 65536, as: UInt64.self).littleEndian)
+    }
+}
+
+// MARK: - Resolved Keys
+
+/// A key whose info has been looked up and checked against `V` once, so reads
+/// and writes through it skip the key info lookup entirely.
+///
+/// ```swift
+/// let fan = try await SMCKit.shared.resolve("F0Ac", as: Float.self)
+/// let rpm = try await SMCKit.shared.read(fan)
+/// ```
+///
+/// A resolved key is not tied to the connection that resolved it and can be
+/// used with `SMCKit`, `SMCPool` and `SMCHandle` alike.
+public struct SMCKey<V: SMCCodable>: Sendable {
+    let handle: SMCKeyHandle_t
+
+    public var code: FourCharCode { handle.key }
+    public var dataType: DataType { DataType(type: handle.dataType, size: handle.dataSize) }
+}
+
+// MARK: - Firmware
+
+/// The SMC firmware version, as reported by the SMC's version command.
+public struct SMCVersion: Equatable, Sendable, CustomStringConvertible {
+    public let major: UInt8
+    public let minor: UInt8
+    public let build: UInt8
+    public let release: UInt16
+
+    init(_ vers: SMCKeyData_vers_t) {
+        self.major = vers.major
+        self.minor = vers.minor
+        self.build = vers.build
+        self.release = vers.release
+    }
+
+    public var description: String {
+        "\(major).\(minor)f\(build) (\(release))"
+    }
+}
+
+/// The power limits reported by the SMC's power limit command, read in a
+/// single transaction.
+public struct SMCPowerLimits: Equatable, Sendable {
+    /// The layout version of the limits the SMC returned.
+    public let version: UInt16
+    public let cpu: UInt32
+    public let gpu: UInt32
+    public let memory: UInt32
+
+    init(_ limits: SMCKeyData_pLimitData_t) {
+        self.version = limits.version
+        self.cpu = limits.cpuPLimit
+        self.gpu = limits.gpuPLimit
+        self.memory = limits.memPLimit
     }
 }
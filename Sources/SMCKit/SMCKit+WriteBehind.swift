@@ -0,0 +1,160 @@
+import Foundation
+import SMC
+
+/// Buffers writes to SMC keys and sends them in batches.
+///
+/// Meant for control loops, such as fan or power targets, that recompute the
+/// same keys far more often than their values change. The last value written
+/// to each key is remembered, and a write that matches it with nothing else
+/// pending for the key is dropped. Anything else is held for `window` seconds,
+/// with later writes to the same key replacing earlier ones, and then every
+/// pending key goes out in a single batched pass.
+///
+/// ```swift
+/// let fans = SMCWriteBehind(window: 0.1)
+/// try await fans.write("F0Tg", Float(2400))
+/// try await fans.write("F0Tg", Float(2600))  // replaces the pending 2400
+/// ```
+///
+/// Pending writes are dropped if the instance is released first; call
+/// `flush()` to send them right away.
+public actor SMCWriteBehind {
+    public typealias ErrorHandler = @Sendable (FourCharCode, Error) -> Void
+
+    private let smc: SMCKit
+    private let window: UInt64
+    private let onError: ErrorHandler?
+
+    /// The last value the SMC accepted for each key.
+    private var written: [FourCharCode: SMCVal_t] = [:]
+    /// Values sent by a flush that hasn't returned yet. Once it does they will
+    /// be what the SMC holds, so new writes are compared against these first.
+    private var inFlight: [FourCharCode: SMCVal_t] = [:]
+    /// Values waiting for the next flush, kept in the order their keys were
+    /// first written.
+    private var pending: [FourCharCode: SMCVal_t] = [:]
+    private var order: [FourCharCode] = []
+    private var scheduled: Task<Void, Never>?
+
+    /// - parameter smc: The SMC instance to write through
+    /// - parameter window: How long, in seconds, writes are held before they
+    ///   are sent. With `0` they are sent as soon as the caller yields, which
+    ///   still merges writes made back to back.
+    /// - parameter onError: Called for every key whose write fails in a flush
+    ///   this instance schedules itself.
+    public init(smc: SMCKit = .shared, window: TimeInterval = 0.05, onError: ErrorHandler? = nil) {
+        precondition(window >= 0, "SMCWriteBehind window must not be negative")
+
+        self.smc = smc
+        self.window = UInt64(window * 1e9)
+        self.onError = onError
+    }
+
+    /// The number of keys waiting to be written.
+    public var pendingCount: Int {
+        order.count
+    }
+
+    /// Queues `value` for `key`, unless it is the value last written there, or
+    /// being written there by a flush under way.
+    ///
+    /// Only encoding errors are thrown; failures of the write itself are
+    /// reported by the flush that sends it.
+    public func write<V: SMCCodable>(_ key: FourCharCode, _ value: V) throws {
+        let val = SMCVal_t(
+            key: key.toCharArray(),
+            dataSize: V.smcDataType.size,
+            dataType: V.smcDataType.type.toCharArray(),
+            bytes: try value.encode()
+        )
+
+        if let last = inFlight[key] ?? written[key], last.hasSameBytes(as: val) {
+            // Back to the value the SMC already holds, so whatever was pending
+            // for the key no longer needs to go out.
+            if pending.removeValue(forKey: key) != nil {
+                order.removeAll { $0 == key }
+            }
+            return
+        }
+
+        if pending.updateValue(val, forKey: key) == nil {
+            order.append(key)
+        }
+        scheduleFlush()
+    }
+
+    /// Sends every pending write now, returning the keys whose writes failed.
+    ///
+    /// A failed key's remembered value is cleared, so the next write to it is
+    /// sent even if it repeats the failed value.
+    @discardableResult
+    public func flush() async -> [(key: FourCharCode, error: Error)] {
+        scheduled?.cancel()
+        scheduled = nil
+
+        guard !order.isEmpty else { return [] }
+
+        let keys = order
+        let vals = keys.map { pending[$0]! }
+        pending.removeAll(keepingCapacity: true)
+        order.removeAll(keepingCapacity: true)
+        for (key, val) in zip(keys, vals) {
+            inFlight[key] = val
+        }
+
+        let results = await smc.writeRaw(vals)
+
+        var failures: [(key: FourCharCode, error: Error)] = []
+        for (i, result) in results.enumerated() {
+            // A later flush may already be sending a newer value for the key.
+            if inFlight[keys[i]]?.hasSameBytes(as: vals[i]) == true {
+                inFlight[keys[i]] = nil
+            }
+
+            switch result {
+            case .success:
+                written[keys[i]] = vals[i]
+            case .failure(let error):
+                written[keys[i]] = nil
+                failures.append((keys[i], error))
+            }
+        }
+        return failures
+    }
+
+    /// Forgets the value last written to `key`, or to every key when `key` is
+    /// `nil`, so the next write goes out even if it repeats it. Use this when
+    /// something other than this instance may have changed the key, for
+    /// example after the system takes back control of a fan.
+    public func invalidate(_ key: FourCharCode? = nil) {
+        if let key {
+            written[key] = nil
+        } else {
+            written.removeAll()
+        }
+    }
+
+    private func scheduleFlush() {
+        guard scheduled == nil else { return }
+
+        let window = window
+        scheduled = Task { [weak self] in
+            if window > 0 {
+                try? await Task.sleep(nanoseconds: window)
+            }
+            guard !Task.isCancelled else { return }
+            await self?.scheduledFlush()
+        }
+    }
+
+    private func scheduledFlush() async {
+        scheduled = nil
+
+        let failures = await flush()
+        if let onError {
+            for failure in failures {
+                onError(failure.key, failure.error)
+            }
+        }
+    }
+}
@@ -6,319 +6,364 @@ import SMC
 public actor SMCKit {
     public static let shared: SMCKit = try! SMCKit()
 
-    private var connection: io_connect_t = 0
-
-    private init() throws {
-        var conn: io_connect_t = 0
-        let result = SMCOpen(&conn)
+    private let context: OpaquePointer
+    private let connection: SMCConnection
+    /// Keeps a recorder or replay alive for as long as the context uses it.
+    let transport: SMCTransport
+    private let io = SMCIOQueue(label: "com.srimanachanta.SMCKit.io")
+
+    private struct CachedValue {
+        let val: SMCVal_t
+        /// Uptime in nanoseconds after which the value is read again.
+        let expires: UInt64
+    }
 
-        guard result == kIOReturnSuccess else {
+    private typealias BatchRead = Task<[Result<SMCVal_t, Error>], Never>
+
+    /// Lifetime in nanoseconds of each key opted into the value cache.
+    private var valueTTLs: [FourCharCode: UInt64] = [:]
+    private var values: [FourCharCode: CachedValue] = [:]
+    /// Reads of cached keys that are under way, with the key's position in the
+    /// batch, for concurrent readers to wait on.
+    private var inFlight: [FourCharCode: (read: BatchRead, index: Int)] = [:]
+
+    /// Opens a connection with a key info cache of its own.
+    ///
+    /// - parameter cacheCapacity: The most keys the cache holds before evicting
+    ///   ones that haven't been used recently, or `0` for no limit.
+    /// - parameter transport: What the connection sends its commands through;
+    ///   see `SMCTransport`.
+    public init(cacheCapacity: Int = 0, transport: SMCTransport = .iokit) throws {
+        precondition(cacheCapacity >= 0, "cacheCapacity must not be negative")
+
+        var created: OpaquePointer?
+        let result = SMCContextCreateWithTransport(
+            UInt32(clamping: cacheCapacity), transport.pointer, &created)
+
+        guard result == kIOReturnSuccess, let created else {
             throw SMCError.connectionFailed(kIOReturn: result)
         }
-        self.connection = conn
+        self.context = created
+        self.connection = SMCConnection(context: created)
+        self.transport = transport
     }
 
     deinit {
-        SMCCleanupCache()
-        SMCClose(connection)
+        SMCContextDestroy(context)
     }
 
-    /// Clears the internal key information cache.
-    /// This can be useful to free memory if you've queried many keys and won't need them again.
-    /// Note: The cache is global and shared across the application.
+    /// Runs `body` on the I/O queue, so the caller suspends rather than blocking
+    /// a concurrency thread for the length of the SMC transaction. Calls still
+    /// reach the SMC one at a time and in order.
+    private func perform<T>(_ body: @escaping (SMCConnection) throws -> T) async throws -> T {
+        let connection = connection
+        return try await io.perform { try body(connection) }
+    }
+
+    private func performNonThrowing<T>(_ body: @escaping (SMCConnection) -> T) async -> T {
+        let connection = connection
+        return await io.performNonThrowing { body(connection) }
+    }
+
+    /// Clears this instance's key information cache.
+    /// The next access to each key fetches its information from the SMC again.
+    /// Other `SMCKit` instances, pools and handles keep their cached keys.
     public func clearCache() {
-        SMCCleanupCache()
-    }
-
-    public func getKeyInformation(_ key: FourCharCode) throws -> DataType {
-        var keyInfo = SMCKeyData_keyInfo_t()
-        let result = SMCGetKeyInfo(key, &keyInfo, self.connection)
-
-        switch (result.kern_res, result.smc_res) {
-        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
-            return DataType(
-                type: keyInfo.dataType,
-                size: UInt32(keyInfo.dataSize)
-            )
-        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
-            throw SMCError.keyNotFound(key: key.toString())
-        case (kIOReturnNotPrivileged, _):
-            throw SMCError.notPrivileged
-        default:
-            throw SMCError.unknown(
-                key: key.toString(),
-                kIOReturn: result.kern_res,
-                SMCResult: result.smc_res
-            )
+        SMCContextResetCache(context)
+    }
+
+    /// Opts `keys` into the value cache: a read served within `ttl` seconds of
+    /// the last one returns the same bytes without an SMC call, and reads that
+    /// arrive while one is under way wait for it instead of issuing their own.
+    /// Writes through this instance drop the key's cached value. A `ttl` of
+    /// `0` opts the keys back out.
+    ///
+    /// Only `read` and `readRaw(_ keys:)` go through the value cache; the reads
+    /// into caller-owned buffers always reach the SMC.
+    public func cacheValues(of keys: [FourCharCode], for ttl: TimeInterval) {
+        precondition(ttl >= 0, "ttl must not be negative")
+
+        for key in keys {
+            valueTTLs[key] = ttl > 0 ? UInt64(ttl * 1e9) : nil
+            values[key] = nil
         }
     }
 
-    public func isKeyFound(_ key: FourCharCode) throws -> Bool {
-        do {
-            let _ = try getKeyInformation(key)
-            return true
-        } catch SMCError.keyNotFound {
-            return false
-        } catch let error {
-            throw error
+    /// Drops every cached value, keeping the keys opted in.
+    public func clearValueCache() {
+        values.removeAll()
+    }
+
+    /// The number of keys currently in this instance's key information cache.
+    public var cachedKeyCount: Int {
+        SMCContextCacheCount(context)
+    }
+
+    /// Fills the key information cache with every key the SMC reports, so later
+    /// reads don't pay for a key info lookup the first time each key is touched.
+    public func warmCache() async throws {
+        try await perform { try $0.warmCache() }
+    }
+
+    /// Like `warmCache()`, but reuses the key information saved at `url` if it
+    /// was written for the same SMC firmware. Otherwise the cache is filled
+    /// from the SMC and saved to `url` for next time.
+    public func warmCache(from url: URL) async throws {
+        try await perform { try $0.warmCache(from: url) }
+    }
+
+    /// Like `warmCache()`, then freezes the complete key set into a read-only
+    /// table that serves every later lookup of those keys without locks or
+    /// writes. Keys the SMC didn't report still go through the regular cache.
+    /// `clearCache()` drops the frozen table too.
+    ///
+    /// The frozen table holds every key whatever the cache's capacity.
+    public func freezeCache() async throws {
+        try await perform { try $0.freezeCache() }
+    }
+
+    /// Reads the type of every key into an `SMCKeyCatalog` for category queries
+    /// such as all temperature (`T`) or fan (`F`) keys. Fills the key
+    /// information cache along the way.
+    public func catalog() async throws -> SMCKeyCatalog {
+        try await perform { try $0.catalog() }
+    }
+
+    /// Instrumentation counters for the whole process, see `SMCStatistics`.
+    public nonisolated var statistics: SMCStatistics {
+        SMCStatistics.current
+    }
+
+    public func getKeyInformation(_ key: FourCharCode) async throws -> DataType {
+        try await perform { try $0.getKeyInformation(key) }
+    }
+
+    public func isKeyFound(_ key: FourCharCode) async throws -> Bool {
+        try await perform { try $0.isKeyFound(key) }
+    }
+
+    public func read<V: SMCCodable>(_ key: FourCharCode) async throws -> V {
+        guard valueTTLs[key] != nil else {
+            return try await perform { try $0.read(key) }
         }
+        return try V(await cachedReadRaw([key])[0].get().bytes)
     }
 
-    public func read<V: SMCCodable>(_ key: FourCharCode) throws -> V {
-        var keyCharArray = key.toCharArray()
-        var smcVal = SMCVal_t()
-
-        let result = SMCReadKey(&keyCharArray, &smcVal, self.connection)
-
-        switch (result.kern_res, result.smc_res) {
-        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
-            return try V(smcVal.bytes)
-        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
-            throw SMCError.keyNotFound(key: key.toString())
-        case (kIOReturnNotPrivileged, _):
-            throw SMCError.notPrivileged
-        default:
-            throw SMCError.unknown(
-                key: key.toString(),
-                kIOReturn: result.kern_res,
-                SMCResult: result.smc_res
-            )
+    /// Reads several keys in a single pass, returning one result per key in the
+    /// same order as `keys`.
+    public func read<V: SMCCodable>(_ keys: [FourCharCode]) async -> [Result<V, Error>] {
+        guard !valueTTLs.isEmpty else {
+            return await performNonThrowing { $0.read(keys) }
+        }
+        return await cachedReadRaw(keys).map { result in
+            result.flatMap { val in Result { try V(val.bytes) } }
         }
     }
 
-    public func write<V: SMCCodable>(_ key: FourCharCode, _ value: V) throws {
-        var buf = SMCVal_t(
-            key: key.toCharArray(),
-            dataSize: V.smcDataType.size,
-            dataType: V.smcDataType.type.toCharArray(),
-            bytes: try value.encode()
-        )
-
-        let result = SMCWriteKey(&buf, self.connection)
-
-        switch (result.kern_res, result.smc_res) {
-        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
-            break
-        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
-            throw SMCError.keyNotFound(key: key.toString())
-        case (kIOReturnBadArgument, UInt8(kSMCReturnDataTypeMismatch)):
-            throw SMCError.dataTypeMismatch(key: key.toString())
-        case (kIOReturnNotPrivileged, _):
-            throw SMCError.notPrivileged
-        default:
-            throw SMCError.unknown(
-                key: key.toString(),
-                kIOReturn: result.kern_res,
-                SMCResult: result.smc_res
-            )
+    /// Like `read(_ keys:)`, but returns the undecoded values.
+    public func readRaw(_ keys: [FourCharCode]) async -> [Result<SMCVal_t, Error>] {
+        guard !valueTTLs.isEmpty else {
+            return await performNonThrowing { $0.readRaw(keys) }
         }
+        return await cachedReadRaw(keys)
     }
 
-    public func readData(_ key: FourCharCode) throws -> Data {
-        var keyCharArray = key.toCharArray()
-        var smcVal = SMCVal_t()
+    /// Like `readRaw(_ keys:)`, but fills caller-owned storage instead of
+    /// returning an array: `vals[i]` and `results[i]` receive the value and
+    /// status of `keys[i]`, and the number of successful reads is returned.
+    /// Both buffers must hold at least `keys.count` elements. Nothing is
+    /// allocated per key, so one pair of buffers can be reused for every dump
+    /// of the full key set.
+    ///
+    /// The buffers must stay valid until the call returns.
+    @discardableResult
+    public func readRaw(
+        _ keys: [FourCharCode], into vals: UnsafeMutableBufferPointer<SMCVal_t>,
+        results: UnsafeMutableBufferPointer<SMCResult_t>
+    ) async -> Int {
+        await performNonThrowing { $0.readRaw(keys, into: vals, results: results) }
+    }
 
-        let result = SMCReadKey(&keyCharArray, &smcVal, self.connection)
+    /// Times each read of `keys` for `SMCSampler`, see
+    /// `SMCConnection.readRawTimed`. Bypasses the value cache.
+    func readRawTimed(_ keys: [FourCharCode], until deadline: UInt64) async
+        -> [SMCConnection.TimedRead?]
+    {
+        await performNonThrowing { $0.readRawTimed(keys, until: deadline) }
+    }
 
-        switch (result.kern_res, result.smc_res) {
-        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
-            let validSize = min(Int(smcVal.dataSize), MemoryLayout<SMCBytes_t>.size)
-            return withUnsafeBytes(of: smcVal.bytes) { buffer in
-                Data(buffer.prefix(validSize))
-            }
-        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
-            throw SMCError.keyNotFound(key: key.toString())
-        case (kIOReturnNotPrivileged, _):
-            throw SMCError.notPrivileged
-        default:
-            throw SMCError.unknown(
-                key: key.toString(),
-                kIOReturn: result.kern_res,
-                SMCResult: result.smc_res
-            )
+    public func write<V: SMCCodable>(_ key: FourCharCode, _ value: V) async throws {
+        invalidateValue(key)
+        try await perform { try $0.write(key, value) }
+    }
+
+    /// Writes several values in a single pass, returning one result per value in
+    /// the same order as `vals`. Each value must carry its key, type and size,
+    /// as `SMCWriteBehind` builds them.
+    public func writeRaw(_ vals: [SMCVal_t]) async -> [Result<Void, Error>] {
+        for val in vals {
+            invalidateValue(FourCharCode(fromCharArray: val.key))
         }
+        return await performNonThrowing { $0.writeRaw(vals) }
     }
 
-    public func readString(_ key: FourCharCode) throws -> String {
-        var keyCharArray = key.toCharArray()
-        var smcVal = SMCVal_t()
+    /// Looks up `key` once and checks it holds a `V`. Reads and writes through the
+    /// returned key skip the key info lookup.
+    public func resolve<V: SMCCodable>(_ key: FourCharCode, as type: V.Type = V.self) async throws
+        -> SMCKey<V>
+    {
+        try await perform { try $0.resolve(key, as: type) }
+    }
 
-        let result = SMCReadKey(&keyCharArray, &smcVal, self.connection)
+    public func read<V: SMCCodable>(_ key: SMCKey<V>) async throws -> V {
+        try await perform { try $0.read(key) }
+    }
 
-        switch (result.kern_res, result.smc_res) {
-        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
-            let validSize = min(Int(smcVal.dataSize), MemoryLayout<SMCBytes_t>.size)
-            let bytes = withUnsafeBytes(of: smcVal.bytes) { buffer in
-                Array(buffer.prefix(validSize))
-            }
+    public func write<V: SMCCodable>(_ key: SMCKey<V>, _ value: V) async throws {
+        invalidateValue(key.code)
+        try await perform { try $0.write(key, value) }
+    }
 
-            let endIndex = bytes.firstIndex(of: 0) ?? bytes.count
-            let stringBytes = Array(bytes.prefix(endIndex))
+    public func readData(_ key: FourCharCode) async throws -> Data {
+        try await perform { try $0.readData(key) }
+    }
 
-            guard let string = String(bytes: stringBytes, encoding: .ascii) else {
-                throw SMCError.invalidStringData(key: key.toString())
-            }
-            return string
-        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
-            throw SMCError.keyNotFound(key: key.toString())
-        case (kIOReturnNotPrivileged, _):
-            throw SMCError.notPrivileged
-        default:
-            throw SMCError.unknown(
-                key: key.toString(),
-                kIOReturn: result.kern_res,
-                SMCResult: result.smc_res
-            )
-        }
+    /// Copies the bytes of `key` into `buffer` without allocating, returning
+    /// how many were copied: the value's size, or `buffer.count` if that is
+    /// smaller. `SMCBytes_t` is 32 bytes, so a buffer that size holds any key.
+    public func readInto(_ key: FourCharCode, buffer: UnsafeMutableRawBufferPointer) async throws
+        -> Int
+    {
+        try await perform { try $0.readInto(key, buffer: buffer) }
     }
 
-    public func writeData(_ key: FourCharCode, _ value: Data) throws {
-        let keyInfo = try getKeyInformation(key)
+    public func readString(_ key: FourCharCode) async throws -> String {
+        try await perform { try $0.readString(key) }
+    }
 
-        guard keyInfo.type == DataTypes.HexData.type else {
-            throw SMCError.dataTypeMismatch(key: key.toString())
-        }
+    public func writeData(_ key: FourCharCode, _ value: Data) async throws {
+        invalidateValue(key)
+        try await perform { try $0.writeData(key, value) }
+    }
 
-        guard value.count == keyInfo.size else {
-            throw SMCError.invalidDataSize(
-                key: key.toString(),
-                expected: keyInfo.size,
-                actual: UInt32(value.count)
-            )
-        }
+    public func writeString(_ key: FourCharCode, _ value: String) async throws {
+        invalidateValue(key)
+        try await perform { try $0.writeString(key, value) }
+    }
 
-        var bytes: SMCBytes_t = (
-            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-            0, 0, 0
-        )
-        value.withUnsafeBytes { buffer in
-            withUnsafeMutableBytes(of: &bytes) { dest in
-                dest.copyBytes(
-                    from: buffer.prefix(min(buffer.count, MemoryLayout<SMCBytes_t>.size)))
-            }
-        }
+    /// The SMC firmware version. It is read once and then cached for the life
+    /// of this instance's connection.
+    public func version() async throws -> SMCVersion {
+        try await perform { try $0.version() }
+    }
 
-        var buf = SMCVal_t(
-            key: key.toCharArray(),
-            dataSize: keyInfo.size,
-            dataType: keyInfo.type.toCharArray(),
-            bytes: bytes
-        )
-
-        let result = SMCWriteKey(&buf, self.connection)
-
-        switch (result.kern_res, result.smc_res) {
-        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
-            break
-        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
-            throw SMCError.keyNotFound(key: key.toString())
-        case (kIOReturnBadArgument, UInt8(kSMCReturnDataTypeMismatch)):
-            throw SMCError.dataTypeMismatch(key: key.toString())
-        case (kIOReturnNotPrivileged, _):
-            throw SMCError.notPrivileged
-        default:
-            throw SMCError.unknown(
-                key: key.toString(),
-                kIOReturn: result.kern_res,
-                SMCResult: result.smc_res
-            )
-        }
+    /// The CPU, GPU and memory power limits, read in a single SMC transaction.
+    public func powerLimits() async throws -> SMCPowerLimits {
+        try await perform { try $0.powerLimits() }
     }
 
-    public func writeString(_ key: FourCharCode, _ value: String) throws {
-        let keyInfo = try getKeyInformation(key)
+    public func numKeys() async throws -> UInt32 {
+        try await perform { try $0.numKeys() }
+    }
 
-        guard keyInfo.type == DataTypes.Ch8String.type else {
-            throw SMCError.dataTypeMismatch(key: key.toString())
-        }
+    public func allKeys() async throws -> [FourCharCode] {
+        try await perform { try $0.allKeys() }
+    }
 
-        guard let stringBytes = value.data(using: .ascii) else {
-            throw SMCError.invalidStringData(key: key.toString())
-        }
+    func keys(in indices: Range<UInt32>) async throws -> [FourCharCode] {
+        try await perform { try $0.keys(in: indices) }
+    }
 
-        guard stringBytes.count <= keyInfo.size else {
-            throw SMCError.invalidDataSize(
-                key: key.toString(),
-                expected: keyInfo.size,
-                actual: UInt32(stringBytes.count)
-            )
-        }
+    /// Enumerates all keys, yielding them as they are discovered.
+    ///
+    /// Keys are fetched `chunkSize` at a time, and other calls on this instance
+    /// can run between chunks, so a full enumeration doesn't hold up other SMC
+    /// users. The index-to-key table is cached by the C library, so enumerating
+    /// again later doesn't go back to the SMC.
+    public nonisolated func keys(chunkSize: Int = 64) -> AsyncThrowingStream<FourCharCode, Error> {
+        precondition(chunkSize > 0, "chunkSize must be positive")
+
+        return AsyncThrowingStream { continuation in
+            let task = Task {
+                do {
+                    let count = try await self.numKeys()
+                    var start: UInt32 = 0
+
+                    while start < count, !Task.isCancelled {
+                        let end = start + min(UInt32(chunkSize), count - start)
+                        for key in try await self.keys(in: start..<end) {
+                            continuation.yield(key)
+                        }
+                        start = end
+                    }
+                    continuation.finish()
+                } catch {
+                    continuation.finish(throwing: error)
+                }
+            }
 
-        var bytes: SMCBytes_t = (
-            0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
-            0, 0, 0
-        )
-        stringBytes.withUnsafeBytes { buffer in
-            withUnsafeMutableBytes(of: &bytes) { dest in
-                dest.copyBytes(
-                    from: buffer.prefix(min(buffer.count, MemoryLayout<SMCBytes_t>.size)))
+            continuation.onTermination = { _ in
+                task.cancel()
             }
         }
+    }
 
-        var buf = SMCVal_t(
-            key: key.toCharArray(),
-            dataSize: keyInfo.size,
-            dataType: keyInfo.type.toCharArray(),
-            bytes: bytes
-        )
-
-        let result = SMCWriteKey(&buf, self.connection)
-
-        switch (result.kern_res, result.smc_res) {
-        case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
-            break
-        case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
-            throw SMCError.keyNotFound(key: key.toString())
-        case (kIOReturnBadArgument, UInt8(kSMCReturnDataTypeMismatch)):
-            throw SMCError.dataTypeMismatch(key: key.toString())
-        case (kIOReturnNotPrivileged, _):
-            throw SMCError.notPrivileged
-        default:
-            throw SMCError.unknown(
-                key: key.toString(),
-                kIOReturn: result.kern_res,
-                SMCResult: result.smc_res
-            )
-        }
+    /// Drops the key's cached value, and keeps a read issued before a write
+    /// from caching what it returns.
+    private func invalidateValue(_ key: FourCharCode) {
+        values[key] = nil
+        inFlight[key] = nil
     }
 
-    public func numKeys() throws -> UInt32 {
-        let result: BigEndian<UInt32> = try self.read(FourCharCode(fromStaticString: "#KEY"))
-        return result.value
-    }
-
-    public func allKeys() throws -> [FourCharCode] {
-        let numKeys = try self.numKeys()
-        var keys: [FourCharCode] = []
-        keys.reserveCapacity(Int(numKeys))
-
-        for index in 0..<numKeys {
-            var keyBuffer = UInt32Char_t(chars: (0, 0, 0, 0, 0))
-
-            let result = SMCGetKeyFromIndex(
-                index,
-                &keyBuffer,
-                self.connection
-            )
-
-            switch (result.kern_res, result.smc_res) {
-            case (kIOReturnSuccess, UInt8(kSMCReturnSuccess)):
-                keys.append(FourCharCode(fromCharArray: keyBuffer))
-            case (kIOReturnSuccess, UInt8(kSMCReturnKeyNotFound)):
-                throw SMCError.keyNotFound(key: "Index \(index)")
-            case (kIOReturnBadArgument, UInt8(kSMCReturnDataTypeMismatch)):
-                throw SMCError.dataTypeMismatch(key: "Index \(index)")
-            case (kIOReturnNotPrivileged, _):
-                throw SMCError.notPrivileged
-            default:
-                throw SMCError.unknown(
-                    key: "Index \(index)",
-                    kIOReturn: result.kern_res,
-                    SMCResult: result.smc_res
-                )
+    /// `readRaw` for when some keys may be in the value cache. Fresh values are
+    /// returned as they are, keys already being read wait on that read, and
+    /// everything else goes out in one batch that later readers can join.
+    private func cachedReadRaw(_ keys: [FourCharCode]) async -> [Result<SMCVal_t, Error>] {
+        let now = DispatchTime.now().uptimeNanoseconds
+
+        var results = [Result<SMCVal_t, Error>?](repeating: nil, count: keys.count)
+        var joined: [(position: Int, read: BatchRead, index: Int)] = []
+        var misses: [Int] = []
+
+        for (i, key) in keys.enumerated() {
+            if valueTTLs[key] != nil {
+                if let cached = values[key], cached.expires > now {
+                    results[i] = .success(cached.val)
+                    continue
+                }
+                if let pending = inFlight[key] {
+                    joined.append((i, pending.read, pending.index))
+                    continue
+                }
+            }
+            misses.append(i)
+        }
+
+        if !misses.isEmpty {
+            let missed = misses.map { keys[$0] }
+            let read: BatchRead = Task { await self.performNonThrowing { $0.readRaw(missed) } }
+
+            for (j, key) in missed.enumerated() where valueTTLs[key] != nil {
+                inFlight[key] = (read, j)
+            }
+
+            let fetched = await read.value
+
+            for (j, key) in missed.enumerated() {
+                results[misses[j]] = fetched[j]
+
+                guard let pending = inFlight[key], pending.read == read else { continue }
+                inFlight[key] = nil
+
+                if case .success(let val) = fetched[j], let ttl = valueTTLs[key] {
+                    values[key] = CachedValue(val: val, expires: now + ttl)
+                }
             }
         }
 
-        return keys
+        for (position, read, index) in joined {
+            results[position] = await read.value[index]
+        }
+        return results.map { $0! }
     }
 }